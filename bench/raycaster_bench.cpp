@@ -0,0 +1,441 @@
+#include "../core/include.h"
+#include "../core/structures.h"
+#include "../core/renderer.h"
+#include "../core/levelgen.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+
+// Microbenchmarks of the renderer's kernels on fixed synthetic inputs: the DDA,
+// the floor rows, the wall columns, sprite stripes, sortSprites, the shading
+// functions and texture loading. Every kernel is first calibrated to a batch of
+// calls that takes a few milliseconds, then warmed up, then timed over a number
+// of repetitions. The report gives the median, minimum and spread of the time
+// per item across the repetitions, the median is the number to compare before
+// and after a change. Nothing opens a window. Meant for release builds, numbers
+// from debug builds say little.
+//
+// raycaster_bench [filter] [--repetitions N] [--warmup N] [--textures DIR]
+// filter runs only the kernels whose name contains it.
+
+#define BENCH_VIEW_WIDTH 640
+#define BENCH_VIEW_HEIGHT 480
+#define BENCH_MAP_SIZE 512
+#define BENCH_ROOMS_MAP_SIZE 64 // 16 rooms, so the things crowd the one the camera stands in
+#define BENCH_TEXTURE_SIZE 64
+#define BENCH_TEXTURE_COUNT 12
+#define BENCH_SKY_TEXTURE 11
+#define BENCH_RAY_COUNT 4096
+#define BENCH_SHADED_PIXELS (BENCH_VIEW_WIDTH * BENCH_VIEW_HEIGHT)
+#define BENCH_SORTED_SPRITES 4096
+#define BENCH_THING_COUNT 256
+#define BENCH_SEED 1
+
+struct BenchOptions
+{
+    std::string filter;
+    int warmup = 3;
+    int repetitions = 15;
+    double batchMilliseconds = 5; // a timed repetition runs the kernel for at least this long
+    std::string textureDirectory = "textures";
+};
+
+struct BenchStats
+{
+    double median, minimum, mean, deviation; // nanoseconds per item
+};
+
+// Fed with something of every kernel's output, so none of them is optimized away
+volatile uint64_t benchSink = 0;
+
+// Same texture layout as the full-frame benchmark: walls 1-8, floor 3, ceiling 6,
+// sprites 8-10 and the sky last.
+const LevelGenTextures benchTextures = {0, 8, 3, 6, 8, 3};
+
+template<typename F>
+double Bench_TimeBatch(F& kernel, const int calls)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    for (int i = 0; i < calls; i++)
+    {
+        kernel();
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+inline BenchStats Bench_GetStats(std::vector<double> samples)
+{
+    std::ranges::sort(samples);
+    const auto count = static_cast<double>(samples.size());
+
+    BenchStats stats = {};
+    stats.minimum = samples.front();
+    stats.median = samples.size() % 2 == 1 ? samples[samples.size() / 2] : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+    for (const double sample: samples)
+    {
+        stats.mean += sample / count;
+    }
+    for (const double sample: samples)
+    {
+        stats.deviation += (sample - stats.mean) * (sample - stats.mean) / count;
+    }
+    stats.deviation = std::sqrt(stats.deviation);
+    return stats;
+}
+
+// Times kernel(), which processes itemsPerCall items per call. The rate is printed
+// in the given unit, unitItems items per second each.
+template<typename F>
+void Bench_Run(const BenchOptions* options, const char* name, const char* unit, const double unitItems, const double itemsPerCall, F&& kernel)
+{
+    if (!options->filter.empty() && std::string(name).find(options->filter) == std::string::npos)
+    {
+        return;
+    }
+
+    int calls = 1;
+    while (Bench_TimeBatch(kernel, calls) < options->batchMilliseconds * 1e6 && calls < (1 << 24))
+    {
+        calls *= 2;
+    }
+
+    for (int i = 0; i < options->warmup; i++)
+    {
+        Bench_TimeBatch(kernel, calls);
+    }
+
+    std::vector<double> samples(options->repetitions);
+    for (double& sample: samples)
+    {
+        sample = Bench_TimeBatch(kernel, calls) / (calls * itemsPerCall);
+    }
+
+    const BenchStats stats = Bench_GetStats(samples);
+    printf("%-24s %12.2f %12.2f %9.1f%% %14.2f  %s\n", name, stats.median, stats.minimum, 100 * stats.deviation / stats.mean,
+           1e9 / (stats.median * unitItems), unit);
+}
+
+// Deterministic 64 x 64 textures: value noise with a brick-like grid, sprites
+// keep a black border and holes so they have transparent texels.
+inline void Bench_MakeTextures(Texture* textures)
+{
+    std::mt19937 rng(BENCH_SEED);
+    for (int t = 0; t < BENCH_TEXTURE_COUNT; t++)
+    {
+        Texture& tex = textures[t];
+        tex = {};
+        tex.width = BENCH_TEXTURE_SIZE;
+        tex.height = BENCH_TEXTURE_SIZE;
+        tex.pixels = new Pixel[BENCH_TEXTURE_SIZE * BENCH_TEXTURE_SIZE];
+        Texture_UpdateSizeClass(&tex);
+
+        const bool sprite = t >= benchTextures.firstSprite && t < benchTextures.firstSprite + benchTextures.spriteCount;
+        for (int y = 0; y < tex.height; y++)
+        {
+            for (int x = 0; x < tex.width; x++)
+            {
+                Pixel& p = tex.pixels[y * tex.width + x];
+                const bool mortar = x % 16 == 0 || y % 8 == 0;
+                const auto base = static_cast<uint8_t>(mortar ? 60 : 120 + rng() % 100);
+                p.r = base;
+                p.g = static_cast<uint8_t>(base * (t + 1) / BENCH_TEXTURE_COUNT);
+                p.b = static_cast<uint8_t>(255 - base);
+                p.a = 255;
+
+                const bool border = x < 8 || x >= tex.width - 8;
+                if (sprite && (border || rng() % 5 == 0))
+                {
+                    p.rgba = 0;
+                }
+            }
+        }
+    }
+}
+
+// Points the level at the generated layers and the synthetic textures.
+inline void Bench_BindLevel(const GeneratedLevel* generated, Texture* textures, Level* level)
+{
+    GeneratedLevel_Bind(generated, level);
+    level->textures = textures;
+    level->textureCount = BENCH_TEXTURE_COUNT;
+    level->skyTexture = BENCH_SKY_TEXTURE;
+}
+
+// Camera looking at angle, with the plane the way the level generator sets it up.
+inline Camera Bench_GetCamera(const Vector position, const double angle)
+{
+    const Vector direction = {std::cos(angle), std::sin(angle)};
+    return {position, direction, {direction.y * 0.66, -direction.x * 0.66}};
+}
+
+inline void Bench_RayCasting(const BenchOptions* options, const LevelGenKind kind, const char* name)
+{
+    auto generated = std::make_unique<GeneratedLevel>();
+    LevelGen_Generate(generated.get(), kind, BENCH_MAP_SIZE, &benchTextures, BENCH_SEED);
+    Level level = {};
+    GeneratedLevel_Bind(generated.get(), &level);
+
+    // Rays fanning out from the cells along a camera path, all directions covered
+    std::vector<Camera> path;
+    LevelGen_MakeCameraPath(generated.get(), BENCH_RAY_COUNT / 64, &path);
+    std::vector<RayQuery> queries(BENCH_RAY_COUNT);
+    for (int i = 0; i < BENCH_RAY_COUNT; i++)
+    {
+        const double angle = 2 * std::numbers::pi * i / 64;
+        queries[i] = RayQuery_FromDirection(path[i / 64].position, {std::cos(angle), std::sin(angle)}, std::numeric_limits<double>::max());
+    }
+
+    std::vector<RayHit> hits(BENCH_RAY_COUNT);
+    Bench_Run(options, name, "Mrays/s", 1e6, BENCH_RAY_COUNT, [&]
+    {
+        for (int i = 0; i < BENCH_RAY_COUNT; i++)
+        {
+            Ray_Cast(&level, &queries[i], &hits[i]);
+        }
+        benchSink = benchSink + hits[BENCH_RAY_COUNT - 1].cell.x;
+    });
+}
+
+inline void Bench_Passes(const BenchOptions* options, Texture* textures)
+{
+    auto open = std::make_unique<GeneratedLevel>();
+    LevelGen_Generate(open.get(), LEVEL_GEN_OPEN_FIELD, BENCH_MAP_SIZE, &benchTextures, BENCH_SEED);
+    auto rooms = std::make_unique<GeneratedLevel>();
+    LevelGen_Generate(rooms.get(), LEVEL_GEN_SPRITE_ROOMS, BENCH_ROOMS_MAP_SIZE, &benchTextures, BENCH_SEED);
+    LevelGen_PlaceThings(rooms.get(), &benchTextures, BENCH_THING_COUNT, BENCH_SEED);
+
+    constexpr int width = BENCH_VIEW_WIDTH;
+    constexpr int height = BENCH_VIEW_HEIGHT;
+    std::vector<uint32_t> buffer(width * height);
+    std::vector<RayHit> hits(width);
+    std::vector<double> zBuffer(width);
+    RenderScratch scratch;
+
+    // Floor and ceiling of an open field, the whole lower and upper half of the view
+    {
+        Level level = {};
+        Bench_BindLevel(open.get(), textures, &level);
+        const Camera camera = Bench_GetCamera(open->spawn, 0.3);
+        Bench_Run(options, "floor rows", "Mpixels/s", 1e6, width * (height / 2) * 2.0, [&]
+        {
+            Renderer_DrawFloorAndCeiling(RgbaShader{}, &level, &camera, buffer.data(), width, height);
+            benchSink = benchSink + buffer[width * (height - 1)];
+        });
+    }
+
+    // Rooms span cells 17 to 31 of the 64 x 64 level, with the walls at 16 and 32
+    Level level = {};
+    Bench_BindLevel(rooms.get(), textures, &level);
+
+    // A room's wall seen from 2.5 cells away, so columns are tall
+    {
+        const Camera camera = Bench_GetCamera({29.5, 24.5}, 0.3);
+        Renderer_CastWalls(&level, &camera, width, hits.data(), zBuffer.data());
+
+        double wallPixels = 0;
+        for (int x = 0; x < width; x++)
+        {
+            int lineHeight, drawStart, drawEnd;
+            Renderer_GetWallSpan(height, hits[x].distance, &lineHeight, &drawStart, &drawEnd);
+            wallPixels += hits[x].hit ? std::max(drawEnd - drawStart, 0) : 0;
+        }
+
+        Bench_Run(options, "wall columns", "Mpixels/s", 1e6, wallPixels, [&]
+        {
+            Renderer_DrawWalls(RgbaShader{}, &level, &camera, buffer.data(), width, height, hits.data());
+            benchSink = benchSink + buffer[width * (height / 2)];
+        });
+    }
+
+    // The things of a room, seen from its far side
+    {
+        const Camera camera = Bench_GetCamera({17.5, 24.5}, 0);
+        Renderer_CastWalls(&level, &camera, width, hits.data(), zBuffer.data());
+        DepthHierarchy_Build(&scratch.depthHierarchy, zBuffer.data(), width);
+
+        // Sprite pixels drawn per call, counted against a buffer no sprite texel matches
+        std::fill(buffer.begin(), buffer.end(), 0x01020304u);
+        FrameArena_Reset(&scratch.arena);
+        Renderer_DrawSprites(RgbaShader{}, &level, &camera, buffer.data(), width, height, &scratch);
+        const auto spritePixels = static_cast<double>(std::ranges::count_if(buffer, [](const uint32_t p) { return p != 0x01020304u; }));
+
+        Bench_Run(options, "sprite stripes", "Mpixels/s", 1e6, std::max(spritePixels, 1.0), [&]
+        {
+            FrameArena_Reset(&scratch.arena);
+            Renderer_DrawSprites(RgbaShader{}, &level, &camera, buffer.data(), width, height, &scratch);
+            benchSink = benchSink + buffer[width * (height / 2) + width / 2];
+        });
+    }
+
+    FrameArena_Free(&scratch.arena);
+}
+
+inline void Bench_SortSprites(const BenchOptions* options)
+{
+    std::mt19937 rng(BENCH_SEED);
+    std::vector<double> distances(BENCH_SORTED_SPRITES);
+    for (double& distance: distances)
+    {
+        distance = LevelGen_RandomUnit(rng) * 64;
+    }
+
+    // Every call sorts the same unsorted input, restoring it is part of the time
+    std::vector<double> dist(BENCH_SORTED_SPRITES);
+    std::vector<int> order(BENCH_SORTED_SPRITES);
+    std::vector<std::pair<double, int>> sortBuffer(BENCH_SORTED_SPRITES);
+    Bench_Run(options, "sortSprites", "Msprites/s", 1e6, BENCH_SORTED_SPRITES, [&]
+    {
+        std::ranges::copy(distances, dist.begin());
+        for (int i = 0; i < BENCH_SORTED_SPRITES; i++)
+        {
+            order[i] = i;
+        }
+        sortSprites(order.data(), dist.data(), BENCH_SORTED_SPRITES, sortBuffer.data());
+        benchSink = benchSink + order[0];
+    });
+}
+
+inline void Bench_Shading(const BenchOptions* options, Texture* textures)
+{
+    // Texel indices of a texture in a fixed random order, so the fetches are not sequential
+    std::mt19937 rng(BENCH_SEED);
+    std::vector<int> texels(BENCH_SHADED_PIXELS);
+    for (int& texel: texels)
+    {
+        texel = static_cast<int>(rng() % (BENCH_TEXTURE_SIZE * BENCH_TEXTURE_SIZE));
+    }
+    const Texture& tex = textures[1];
+
+    std::vector<uint32_t> rgba(BENCH_SHADED_PIXELS);
+    Bench_Run(options, "shade darken+lighten", "Mpixels/s", 1e6, BENCH_SHADED_PIXELS, [&]
+    {
+        const RgbaShader shader;
+        const auto shade = shader.MakeShade(0.4, 1.25);
+        for (int i = 0; i < BENCH_SHADED_PIXELS; i++)
+        {
+            rgba[i] = shader.Apply(tex, texels[i], shade);
+        }
+        benchSink = benchSink + rgba[BENCH_SHADED_PIXELS - 1];
+    });
+
+    auto palette = std::make_unique<Palette>();
+    Palette_Build(palette.get(), textures, BENCH_TEXTURE_COUNT);
+    Texture indexed = tex;
+    Palette_QuantizeTexture(palette.get(), &indexed);
+
+    std::vector<uint8_t> indices(BENCH_SHADED_PIXELS);
+    Bench_Run(options, "shade colormap", "Mpixels/s", 1e6, BENCH_SHADED_PIXELS, [&]
+    {
+        const IndexedShader shader = {palette.get()};
+        const auto shade = shader.MakeShade(0.4, 1.25);
+        for (int i = 0; i < BENCH_SHADED_PIXELS; i++)
+        {
+            indices[i] = shader.Apply(indexed, texels[i], shade);
+        }
+        benchSink = benchSink + indices[BENCH_SHADED_PIXELS - 1];
+    });
+
+    Bench_Run(options, "shade palette expand", "Mpixels/s", 1e6, BENCH_SHADED_PIXELS, [&]
+    {
+        Palette_Expand(palette.get(), indices.data(), rgba.data(), BENCH_SHADED_PIXELS);
+        benchSink = benchSink + rgba[BENCH_SHADED_PIXELS - 1];
+    });
+
+    std::vector<uint32_t> gbuffer(BENCH_SHADED_PIXELS);
+    for (int i = 0; i < BENCH_SHADED_PIXELS; i++)
+    {
+        Pixel p = tex.pixels[texels[i]];
+        p.a = Deferred_PackAttribute((i % BENCH_VIEW_WIDTH) / static_cast<double>(BENCH_VIEW_WIDTH), 1.0 + (i & 7) / 8.0);
+        gbuffer[i] = p.rgba;
+    }
+    Bench_Run(options, "shade deferred", "Mpixels/s", 1e6, BENCH_SHADED_PIXELS, [&]
+    {
+        Deferred_ShadePixels(gbuffer.data(), rgba.data(), BENCH_SHADED_PIXELS);
+        benchSink = benchSink + rgba[BENCH_SHADED_PIXELS - 1];
+    });
+
+    delete[] indexed.indexedPixels;
+}
+
+// Decoding and converting the textures main loads, in the window format SDL
+// most often reports. Creating the SDL texture needs a renderer and is left out.
+inline void Bench_TextureLoading(const BenchOptions* options)
+{
+    constexpr const char* names[] = {"eagle", "redbrick", "purplestone", "greystone", "bluestone", "mossy",
+                                     "wood", "colorstone", "barrel", "pillar", "greenlight", "sky"};
+    std::vector<std::string> paths;
+    for (const char* name: names)
+    {
+        const std::string path = options->textureDirectory + "/" + name + ".png";
+        if (FILE* file = fopen(path.c_str(), "rb"))
+        {
+            fclose(file);
+            paths.push_back(path);
+        }
+    }
+
+    if (paths.empty())
+    {
+        if (options->filter.empty() || std::string("Texture_LoadPixels").find(options->filter) != std::string::npos)
+        {
+            printf("%-24s skipped, no textures in %s\n", "Texture_LoadPixels", options->textureDirectory.c_str());
+        }
+        return;
+    }
+
+    Bench_Run(options, "Texture_LoadPixels", "Kimages/s", 1e3, static_cast<double>(paths.size()), [&]
+    {
+        for (const std::string& path: paths)
+        {
+            Texture texture = {};
+            SDL_FreeSurface(Texture_LoadPixels(&texture, path, SDL_PIXELFORMAT_ARGB8888));
+            benchSink = benchSink + texture.pixels[0].rgba;
+            Texture_Free(&texture);
+        }
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--repetitions" && i + 1 < argc)
+        {
+            options.repetitions = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--warmup" && i + 1 < argc)
+        {
+            options.warmup = std::max(0, atoi(argv[++i]));
+        }
+        else if (argument == "--textures" && i + 1 < argc)
+        {
+            options.textureDirectory = argv[++i];
+        }
+        else
+        {
+            options.filter = argument;
+        }
+    }
+
+    Texture textures[BENCH_TEXTURE_COUNT];
+    Bench_MakeTextures(textures);
+
+    printf("%-24s %12s %12s %10s %14s\n", "kernel", "median ns", "min ns", "stddev", "median rate");
+    Bench_RayCasting(&options, LEVEL_GEN_OPEN_FIELD, "dda open field");
+    Bench_RayCasting(&options, LEVEL_GEN_MAZE, "dda maze");
+    Bench_Passes(&options, textures);
+    Bench_SortSprites(&options);
+    Bench_Shading(&options, textures);
+    Bench_TextureLoading(&options);
+
+    for (Texture& texture: textures)
+    {
+        Texture_Free(&texture);
+    }
+    return 0;
+}
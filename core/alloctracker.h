@@ -0,0 +1,69 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+#include "include.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every global operator new while TRACK_ALLOCATIONS is defined, so the
+// frame loop can check it reached a zero-allocation steady state. The replacement
+// operators must exist once per program: define ALLOC_TRACKER_IMPLEMENTATION in
+// the translation unit that holds main() before including this header.
+
+inline std::atomic<uint64_t> allocationCount = 0;
+
+inline bool AllocTracker_IsEnabled()
+{
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline uint64_t AllocTracker_GetCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+#if defined(TRACK_ALLOCATIONS) && defined(ALLOC_TRACKER_IMPLEMENTATION)
+
+void* operator new(const size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include "include.h"
+
+#include <cstddef>
+#include <new>
+
+// Linear allocator for data that lives for one frame. Allocation is a pointer
+// bump, FrameArena_Reset at the top of the frame releases everything at once.
+// Requests that do not fit are served from the heap for the rest of the frame
+// and the block grows to cover them at the next reset, so after a few warm-up
+// frames the arena never touches the heap again. A zeroed arena is valid and
+// simply starts empty.
+struct FrameArenaBlock
+{
+    FrameArenaBlock* next;
+    alignas(std::max_align_t) unsigned char data[1];
+};
+
+struct FrameArena
+{
+    unsigned char* memory = nullptr;
+    size_t capacity = 0;
+    size_t offset = 0;
+    size_t highWater = 0;
+    size_t overflowBytes = 0;
+    FrameArenaBlock* overflow = nullptr;
+};
+
+inline void FrameArena_Init(FrameArena* arena, const size_t capacity)
+{
+    arena->memory = static_cast<unsigned char*>(::operator new(capacity));
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->highWater = 0;
+    arena->overflowBytes = 0;
+    arena->overflow = nullptr;
+}
+
+inline void FrameArena_FreeOverflow(FrameArena* arena)
+{
+    while (arena->overflow != nullptr)
+    {
+        FrameArenaBlock* next = arena->overflow->next;
+        ::operator delete(arena->overflow);
+        arena->overflow = next;
+    }
+}
+
+inline void FrameArena_Free(FrameArena* arena)
+{
+    FrameArena_FreeOverflow(arena);
+    ::operator delete(arena->memory);
+    arena->memory = nullptr;
+    arena->capacity = 0;
+    arena->offset = 0;
+}
+
+inline void FrameArena_Reset(FrameArena* arena)
+{
+    arena->highWater = std::max(arena->highWater, arena->offset + arena->overflowBytes);
+
+    if (arena->overflow != nullptr)
+    {
+        FrameArena_FreeOverflow(arena);
+
+        // Grow to last frame's total demand plus some headroom
+        const size_t capacity = arena->highWater + arena->highWater / 2;
+        ::operator delete(arena->memory);
+        arena->memory = static_cast<unsigned char*>(::operator new(capacity));
+        arena->capacity = capacity;
+    }
+
+    arena->offset = 0;
+    arena->overflowBytes = 0;
+}
+
+inline void* FrameArena_Allocate(FrameArena* arena, const size_t size, const size_t alignment)
+{
+    const size_t start = (arena->offset + alignment - 1) & ~(alignment - 1);
+    if (arena->memory != nullptr && start + size <= arena->capacity)
+    {
+        arena->offset = start + size;
+        return arena->memory + start;
+    }
+
+    arena->overflowBytes += size + alignment;
+
+    auto block = static_cast<FrameArenaBlock*>(::operator new(offsetof(FrameArenaBlock, data) + size));
+    block->next = arena->overflow;
+    arena->overflow = block;
+    return block->data;
+}
+
+template<typename T>
+T* FrameArena_AllocArray(FrameArena* arena, const int count)
+{
+    static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is released without running destructors");
+    static_assert(alignof(T) <= alignof(std::max_align_t));
+    return static_cast<T*>(FrameArena_Allocate(arena, sizeof(T) * std::max(count, 0), alignof(T)));
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef ASSET_SEGMENT_H
+#define ASSET_SEGMENT_H
+#include "include.h"
+#include "structures.h"
+#include "palette.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ASSET_SEGMENT_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Converted assets in a named POSIX shared memory segment, so that many renderer
+// processes on one host share a single copy. A publishing process lays out the
+// palette, the RGBA and indexed pixels of every texture and the level layers in
+// the segment. Other processes attach to it read-only and bind their textures,
+// palette and level straight to the mapped memory, which is the only work they
+// do at startup. Writing through a bound texture faults, which is intended.
+// Segment names follow shm_open: one leading slash and no other.
+
+#define ASSET_SEGMENT_VERSION 1
+#define ASSET_SEGMENT_MAX_TEXTURES 64
+#define ASSET_SEGMENT_ALIGNMENT 64
+
+inline constexpr char ASSET_SEGMENT_MAGIC[4] = {'R', 'C', 'A', 'S'};
+
+// Offsets are from the start of the segment, which maps at a different address in every process.
+struct AssetSegmentTexture
+{
+    int32_t width, height;
+    uint64_t pixelsOffset;
+    uint64_t indexedPixelsOffset;
+};
+
+struct AssetSegmentHeader
+{
+    char magic[4]; // written last, attachers reject the segment until it is set
+    uint32_t version;
+    uint64_t size;
+    uint32_t pixelFormat; // SDL pixel format of the RGBA texels
+    int32_t textureCount;
+    int32_t skyTexture;
+    int32_t mapWidth, mapHeight;
+    uint64_t paletteOffset;
+    uint64_t wallsOffset, floorsOffset, ceilingsOffset;
+    uint64_t lightsOffset, ceilingLightsOffset;
+    AssetSegmentTexture textures[ASSET_SEGMENT_MAX_TEXTURES];
+};
+
+struct AssetSegment
+{
+    std::string name;
+    uint8_t* base;
+    size_t size;
+    const AssetSegmentHeader* header;
+    LevelGrid grid; // the level layers of the segment, what Level::grid points at once bound
+};
+
+inline bool AssetSegment_IsSupported()
+{
+#ifdef ASSET_SEGMENT_POSIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline uint64_t AssetSegment_Align(const uint64_t offset)
+{
+    return (offset + ASSET_SEGMENT_ALIGNMENT - 1) & ~static_cast<uint64_t>(ASSET_SEGMENT_ALIGNMENT - 1);
+}
+
+// Lays out everything the header points at, filling in the offsets, and returns the total size.
+inline uint64_t AssetSegment_Layout(AssetSegmentHeader* header, const Level* level)
+{
+    uint64_t offset = AssetSegment_Align(sizeof(AssetSegmentHeader));
+    const auto reserve = [&](const uint64_t bytes)
+    {
+        const uint64_t start = offset;
+        offset = AssetSegment_Align(offset + bytes);
+        return start;
+    };
+
+    header->paletteOffset = reserve(sizeof(Palette));
+    for (int i = 0; i < level->textureCount; i++)
+    {
+        const Texture& tex = level->textures[i];
+        const uint64_t texels = static_cast<uint64_t>(tex.width) * tex.height;
+        header->textures[i].width = tex.width;
+        header->textures[i].height = tex.height;
+        header->textures[i].pixelsOffset = reserve(texels * sizeof(Pixel));
+        header->textures[i].indexedPixelsOffset = reserve(texels);
+    }
+
+    const uint64_t cells = static_cast<uint64_t>(level->mapWidth) * level->mapHeight;
+    header->wallsOffset = reserve(cells * sizeof(int32_t));
+    header->floorsOffset = reserve(cells * sizeof(int32_t));
+    header->ceilingsOffset = reserve(cells * sizeof(int32_t));
+    header->lightsOffset = reserve(cells * sizeof(double));
+    header->ceilingLightsOffset = reserve(cells * sizeof(double));
+    return offset;
+}
+
+// Flattens one dense layer, cell (x, y) at x * height + y like LevelGrid.
+template<typename T, typename Source>
+void AssetSegment_WriteLayer(uint8_t* base, const uint64_t offset, const std::vector<std::vector<Source>>& map, const int width, const int height)
+{
+    const auto layer = reinterpret_cast<T*>(base + offset);
+    for (int x = 0; x < width; x++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            layer[static_cast<size_t>(x) * height + y] = static_cast<T>(map[x][y]);
+        }
+    }
+}
+
+inline void AssetSegment_Reset(AssetSegment* segment)
+{
+    segment->name.clear();
+    segment->base = nullptr;
+    segment->size = 0;
+    segment->header = nullptr;
+    segment->grid = {};
+}
+
+inline void AssetSegment_BindGrid(AssetSegment* segment)
+{
+    const AssetSegmentHeader* header = segment->header;
+    segment->grid.width = header->mapWidth;
+    segment->grid.height = header->mapHeight;
+    segment->grid.walls = reinterpret_cast<const int32_t*>(segment->base + header->wallsOffset);
+    segment->grid.floors = reinterpret_cast<const int32_t*>(segment->base + header->floorsOffset);
+    segment->grid.ceilings = reinterpret_cast<const int32_t*>(segment->base + header->ceilingsOffset);
+    segment->grid.lights = reinterpret_cast<const double*>(segment->base + header->lightsOffset);
+    segment->grid.ceilingLights = reinterpret_cast<const double*>(segment->base + header->ceilingLightsOffset);
+}
+
+// Creates the segment and copies the textures, their indexed pixels, the palette
+// and the dense level layers into it. Fails when a segment of that name exists
+// already, call AssetSegment_Unlink first to replace it. The segment outlives
+// the publishing process until it is unlinked.
+inline bool AssetSegment_Publish(AssetSegment* segment, const std::string& name, const Level* level, const Palette* palette, const uint32_t pixelFormat)
+{
+    AssetSegment_Reset(segment);
+#ifdef ASSET_SEGMENT_POSIX
+    if (level->textureCount > ASSET_SEGMENT_MAX_TEXTURES || level->world != nullptr || level->grid != nullptr)
+    {
+        return false;
+    }
+
+    AssetSegmentHeader header = {};
+    header.version = ASSET_SEGMENT_VERSION;
+    header.pixelFormat = pixelFormat;
+    header.textureCount = level->textureCount;
+    header.skyTexture = level->skyTexture;
+    header.mapWidth = level->mapWidth;
+    header.mapHeight = level->mapHeight;
+    header.size = AssetSegment_Layout(&header, level);
+
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(header.size)) == 0)
+    {
+        mapping = mmap(nullptr, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    const auto base = static_cast<uint8_t*>(mapping);
+    std::memcpy(base + header.paletteOffset, palette, sizeof(Palette));
+    for (int i = 0; i < level->textureCount; i++)
+    {
+        const Texture& tex = level->textures[i];
+        const size_t texels = static_cast<size_t>(tex.width) * tex.height;
+        std::memcpy(base + header.textures[i].pixelsOffset, tex.pixels, texels * sizeof(Pixel));
+        std::memcpy(base + header.textures[i].indexedPixelsOffset, tex.indexedPixels, texels);
+    }
+    AssetSegment_WriteLayer<int32_t>(base, header.wallsOffset, level->wallMap, level->mapWidth, level->mapHeight);
+    AssetSegment_WriteLayer<int32_t>(base, header.floorsOffset, level->floorMap, level->mapWidth, level->mapHeight);
+    AssetSegment_WriteLayer<int32_t>(base, header.ceilingsOffset, level->ceilingMap, level->mapWidth, level->mapHeight);
+    AssetSegment_WriteLayer<double>(base, header.lightsOffset, level->lightMap, level->mapWidth, level->mapHeight);
+    AssetSegment_WriteLayer<double>(base, header.ceilingLightsOffset, level->ceilingLightMap, level->mapWidth, level->mapHeight);
+
+    std::memcpy(base, &header, sizeof(header));
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(base, ASSET_SEGMENT_MAGIC, sizeof(ASSET_SEGMENT_MAGIC));
+
+    segment->name = name;
+    segment->base = base;
+    segment->size = header.size;
+    segment->header = reinterpret_cast<const AssetSegmentHeader*>(base);
+    AssetSegment_BindGrid(segment);
+    return true;
+#else
+    (void)name; (void)level; (void)palette; (void)pixelFormat;
+    return false;
+#endif
+}
+
+// Maps an existing, completely published segment read-only.
+inline bool AssetSegment_Attach(AssetSegment* segment, const std::string& name)
+{
+    AssetSegment_Reset(segment);
+#ifdef ASSET_SEGMENT_POSIX
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(AssetSegmentHeader))
+    {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const auto header = static_cast<const AssetSegmentHeader*>(mapping);
+    const bool published = std::memcmp(header->magic, ASSET_SEGMENT_MAGIC, sizeof(ASSET_SEGMENT_MAGIC)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!published || header->version != ASSET_SEGMENT_VERSION || header->size != static_cast<uint64_t>(info.st_size) ||
+        header->textureCount < 0 || header->textureCount > ASSET_SEGMENT_MAX_TEXTURES)
+    {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    segment->name = name;
+    segment->base = static_cast<uint8_t*>(mapping);
+    segment->size = info.st_size;
+    segment->header = header;
+    AssetSegment_BindGrid(segment);
+    return true;
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+inline const Palette* AssetSegment_GetPalette(const AssetSegment* segment)
+{
+    return reinterpret_cast<const Palette*>(segment->base + segment->header->paletteOffset);
+}
+
+// Points the textures at the segment's texels, without copying. textures needs
+// room for header->textureCount entries. tex stays null, create it from pixels
+// when the texture has to be drawn by SDL.
+inline void AssetSegment_BindTextures(const AssetSegment* segment, Texture* textures)
+{
+    const AssetSegmentHeader* header = segment->header;
+    for (int i = 0; i < header->textureCount; i++)
+    {
+        const AssetSegmentTexture& entry = header->textures[i];
+        Texture& tex = textures[i];
+        tex.tex = nullptr;
+        tex.width = entry.width;
+        tex.height = entry.height;
+        tex.pixels = reinterpret_cast<Pixel*>(segment->base + entry.pixelsOffset);
+        tex.indexedPixels = segment->base + entry.indexedPixelsOffset;
+        tex.sharedPixels = true;
+        Texture_UpdateSizeClass(&tex);
+    }
+}
+
+// Points the level's cells at the segment's layers. The segment must outlive the level.
+inline void AssetSegment_BindLevel(const AssetSegment* segment, Level* level)
+{
+    level->grid = &segment->grid;
+    level->mapWidth = segment->header->mapWidth;
+    level->mapHeight = segment->header->mapHeight;
+    level->skyTexture = segment->header->skyTexture;
+    level->textureCount = segment->header->textureCount;
+}
+
+// Unmaps the segment. Other processes keep their mappings.
+inline void AssetSegment_Detach(AssetSegment* segment)
+{
+#ifdef ASSET_SEGMENT_POSIX
+    if (segment->base != nullptr)
+    {
+        munmap(segment->base, segment->size);
+    }
+#endif
+    AssetSegment_Reset(segment);
+}
+
+// Removes the name, so no new process can attach. Mapped segments stay valid until detached.
+inline void AssetSegment_Unlink(const std::string& name)
+{
+#ifdef ASSET_SEGMENT_POSIX
+    shm_unlink(name.c_str());
+#else
+    (void)name;
+#endif
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include "include.h"
+#include "renderer.h"
+#include "levelgen.h"
+#include "alloctracker.h"
+
+#include <chrono>
+#include <memory>
+
+// Renders fixed camera paths over generated levels and reports frame times for
+// every combination of level kind, map size, thing count, resolution, buffer
+// layout and thread count. Each level is generated once per kind and size,
+// things are re-placed per count. With more than one thread, every step of the
+// path renders one view per thread, the way a multi-agent host would, and the
+// time per frame is the wall time of the step divided by the views. Builds that
+// track allocations or count render stats add their per-frame averages.
+
+enum BenchmarkLayout
+{
+    BENCHMARK_ROW_MAJOR,    // Renderer_DrawCameraView, as Renderer_DrawViews renders
+    BENCHMARK_COLUMN_MAJOR  // Renderer_DrawViewTransposed
+};
+
+inline const char* BenchmarkLayout_GetName(const BenchmarkLayout layout)
+{
+    return layout == BENCHMARK_ROW_MAJOR ? "row-major" : "column-major";
+}
+
+struct BenchmarkMatrix
+{
+    std::vector<LevelGenKind> kinds;
+    std::vector<int> mapSizes;
+    std::vector<int> thingCounts;
+    std::vector<IVector> resolutions;
+    std::vector<BenchmarkLayout> layouts;
+    std::vector<int> threadCounts;
+    int frames;      // steps of the camera path per case
+    int warmupSteps; // steps rendered before timing, so arenas reach their size
+    uint32_t seed;
+};
+
+struct BenchmarkResult
+{
+    LevelGenKind kind;
+    int mapSize;
+    int thingCount;
+    IVector resolution;
+    BenchmarkLayout layout;
+    int threads;
+    double millisecondsPerFrame;
+    double worstStepMilliseconds;
+    double allocationsPerFrame; // with TRACK_ALLOCATIONS
+    RenderCounters counters;    // summed over the timed frames, with RENDER_STATS
+};
+
+// Every kind at 64 to 8192 cells per side, up to a million things, four
+// resolutions up to 1080p in both layouts, one thread and all hardware threads.
+// Takes minutes and needs about 2 GB for the largest levels.
+inline BenchmarkMatrix BenchmarkMatrix_Full()
+{
+    const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    BenchmarkMatrix matrix;
+    matrix.kinds = {LEVEL_GEN_OPEN_FIELD, LEVEL_GEN_MAZE, LEVEL_GEN_CORRIDORS, LEVEL_GEN_SPRITE_ROOMS};
+    matrix.mapSizes = {64, 512, 4096, 8192};
+    matrix.thingCounts = {0, 10000, 100000, 1000000};
+    matrix.resolutions = {{320, 240}, {640, 480}, {1280, 720}, {1920, 1080}};
+    matrix.layouts = {BENCHMARK_ROW_MAJOR, BENCHMARK_COLUMN_MAJOR};
+    matrix.threadCounts = {1};
+    if (hardwareThreads > 1)
+    {
+        matrix.threadCounts.push_back(hardwareThreads);
+    }
+    matrix.frames = 60;
+    matrix.warmupSteps = 4;
+    matrix.seed = 1;
+    return matrix;
+}
+
+// Small enough to run in seconds, to catch regressions rather than map cliffs.
+inline BenchmarkMatrix BenchmarkMatrix_Quick()
+{
+    BenchmarkMatrix matrix;
+    matrix.kinds = {LEVEL_GEN_OPEN_FIELD, LEVEL_GEN_MAZE, LEVEL_GEN_CORRIDORS, LEVEL_GEN_SPRITE_ROOMS};
+    matrix.mapSizes = {64, 1024};
+    matrix.thingCounts = {0, 10000};
+    matrix.resolutions = {{320, 240}};
+    matrix.layouts = {BENCHMARK_ROW_MAJOR};
+    matrix.threadCounts = {1};
+    matrix.frames = 30;
+    matrix.warmupSteps = 2;
+    matrix.seed = 1;
+    return matrix;
+}
+
+inline BenchmarkResult Benchmark_RunCase(const Level* level, const std::vector<Camera>& path, const IVector resolution, const BenchmarkLayout layout,
+                                         const int threads, const int warmupSteps)
+{
+    JobPool pool(threads);
+    std::vector<RenderScratch> scratch(threads);
+    std::vector<RenderStats> stats(threads);
+    if (RenderStats_IsEnabled())
+    {
+        for (int i = 0; i < threads; i++)
+        {
+            scratch[i].stats = &stats[i];
+        }
+    }
+
+    const size_t pixelCount = static_cast<size_t>(resolution.x) * resolution.y;
+    std::vector<uint32_t> pixels(pixelCount * threads);
+    std::vector<View> views(threads);
+    std::vector<Camera> cameras(threads);
+    for (int i = 0; i < threads; i++)
+    {
+        views[i] = {pixels.data() + pixelCount * i, resolution.x, resolution.y, VIEW_FORMAT_RGBA};
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const int pathLength = static_cast<int>(path.size());
+
+    BenchmarkResult result = {};
+    result.resolution = resolution;
+    result.layout = layout;
+    result.threads = threads;
+
+    double totalMilliseconds = 0;
+    uint64_t allocations = 0;
+    for (int step = -warmupSteps; step < pathLength; step++)
+    {
+        // Views of one step look along consecutive stretches of the path
+        for (int i = 0; i < threads; i++)
+        {
+            cameras[i] = path[(std::max(step, 0) + i * pathLength / threads) % pathLength];
+        }
+
+        for (int i = 0; i < threads; i++)
+        {
+            if (scratch[i].stats != nullptr)
+            {
+                RenderStats_Begin(scratch[i].stats, resolution.x, resolution.y);
+            }
+        }
+
+        const uint64_t allocationsBefore = AllocTracker_GetCount();
+        const auto start = Clock::now();
+        if (layout == BENCHMARK_ROW_MAJOR)
+        {
+            Renderer_DrawViews(level, cameras.data(), views.data(), threads, &pool, scratch.data());
+        }
+        else
+        {
+            pool.ParallelFor(threads, [&](const int index, const int worker)
+            {
+                FrameArena_Reset(&scratch[worker].arena);
+                Renderer_DrawViewTransposed(RgbaShader{}, level, &cameras[index], static_cast<uint32_t*>(views[index].pixels), resolution.x, resolution.y,
+                                            &scratch[worker]);
+            });
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        if (step >= 0)
+        {
+            totalMilliseconds += milliseconds;
+            result.worstStepMilliseconds = std::max(result.worstStepMilliseconds, milliseconds);
+            allocations += AllocTracker_GetCount() - allocationsBefore;
+            for (int i = 0; i < threads; i++)
+            {
+                if (scratch[i].stats != nullptr)
+                {
+                    RenderCounters_Accumulate(&result.counters, &scratch[i].stats->counters);
+                }
+            }
+        }
+    }
+
+    for (auto& s: scratch)
+    {
+        FrameArena_Free(&s.arena);
+    }
+
+    const double frames = static_cast<double>(pathLength) * threads;
+    result.millisecondsPerFrame = totalMilliseconds / frames;
+    result.allocationsPerFrame = allocations / frames;
+    return result;
+}
+
+// Columns of the optional counters, appended to the CSV rows in this order.
+inline void Benchmark_PrintCountersHeader()
+{
+    if (AllocTracker_IsEnabled())
+    {
+        printf(",allocations/frame");
+    }
+    if (RenderStats_IsEnabled())
+    {
+        printf(",rays/frame,steps/ray,texels/frame,overdraw,sprites considered/frame,sprites drawn/frame,zbuffer rejections/frame");
+    }
+}
+
+inline void Benchmark_PrintCounters(const BenchmarkResult* result, const int frames)
+{
+    if (AllocTracker_IsEnabled())
+    {
+        printf(",%.2f", result->allocationsPerFrame);
+    }
+    if (RenderStats_IsEnabled())
+    {
+        const RenderCounters& counters = result->counters;
+        const double screenPixels = static_cast<double>(frames) * result->resolution.x * result->resolution.y;
+        printf(",%.0f,%.2f,%.0f,%.3f,%.1f,%.1f,%.1f", counters.raysCast / static_cast<double>(frames),
+               static_cast<double>(counters.ddaSteps) / std::max<uint64_t>(counters.raysCast, 1), counters.texelFetches / static_cast<double>(frames),
+               RenderCounters_GetPixelsWritten(&counters) / screenPixels, counters.spritesConsidered / static_cast<double>(frames),
+               counters.spritesDrawn / static_cast<double>(frames), counters.zBufferRejections / static_cast<double>(frames));
+    }
+}
+
+// Runs the whole matrix on a level that already holds the textures, printing one
+// CSV row per case as soon as it is measured. The level's cells and things are
+// replaced by the generated ones, it has no things and no valid cells afterwards.
+inline std::vector<BenchmarkResult> Benchmark_Run(const BenchmarkMatrix* matrix, Level* level, const LevelGenTextures* textures)
+{
+    std::vector<BenchmarkResult> results;
+    std::vector<Camera> path;
+    auto generated = std::make_unique<GeneratedLevel>();
+
+    printf("kind,map,things,width,height,layout,threads,ms/frame,worst step ms,frames/s");
+    Benchmark_PrintCountersHeader();
+    printf("\n");
+    for (const LevelGenKind kind: matrix->kinds)
+    {
+        for (const int mapSize: matrix->mapSizes)
+        {
+            LevelGen_Generate(generated.get(), kind, mapSize, textures, matrix->seed);
+            LevelGen_MakeCameraPath(generated.get(), matrix->frames, &path);
+
+            for (const int thingCount: matrix->thingCounts)
+            {
+                LevelGen_PlaceThings(generated.get(), textures, thingCount, matrix->seed);
+                GeneratedLevel_Bind(generated.get(), level);
+
+                for (const IVector resolution: matrix->resolutions)
+                {
+                    for (const BenchmarkLayout layout: matrix->layouts)
+                    {
+                        for (const int threads: matrix->threadCounts)
+                        {
+                            BenchmarkResult result = Benchmark_RunCase(level, path, resolution, layout, threads, matrix->warmupSteps);
+                            result.kind = kind;
+                            result.mapSize = mapSize;
+                            result.thingCount = thingCount;
+                            results.push_back(result);
+
+                            printf("%s,%d,%d,%d,%d,%s,%d,%.3f,%.3f,%.1f", LevelGenKind_GetName(kind), mapSize, thingCount, resolution.x, resolution.y,
+                                   BenchmarkLayout_GetName(layout), threads, result.millisecondsPerFrame, result.worstStepMilliseconds,
+                                   1000.0 / result.millisecondsPerFrame);
+                            Benchmark_PrintCounters(&result, static_cast<int>(path.size()) * threads);
+                            printf("\n");
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    level->grid = nullptr;
+    level->things = nullptr;
+    level->thingCount = 0;
+    return results;
+}
+
+#endif
@@ -0,0 +1,563 @@
+#ifndef CHUNKED_WORLD_H
+#define CHUNKED_WORLD_H
+#include "include.h"
+#include "structures.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE)
+
+// Chunks within this many cells beyond the view distance are paged in as well
+#define CHUNK_PREFETCH_MARGIN 8
+// Frames of the current movement the pager looks ahead
+#define CHUNK_LOOKAHEAD_FRAMES 30
+
+// Every layer of a CHUNK_SIZE x CHUNK_SIZE block of cells, indexed like the
+// dense maps: cell (x, y) of the chunk is at x * CHUNK_SIZE + y. Stored on
+// disk exactly like this, in little-endian byte order.
+struct ChunkData
+{
+    uint16_t walls[CHUNK_CELLS];
+    uint16_t floors[CHUNK_CELLS];
+    uint16_t ceilings[CHUNK_CELLS];
+    float lights[CHUNK_CELLS];
+    float ceilingLights[CHUNK_CELLS];
+};
+
+// World file: this header followed by the chunks in row order, chunk (cx, cy)
+// at index cy * chunksX + cx.
+struct ChunkedWorldHeader
+{
+    char magic[4];
+    int32_t width, height;
+    int32_t chunkSize;
+    float spawnX, spawnY;
+    int32_t fogTexture; // texture shown for cells whose chunk is not resident
+};
+
+inline constexpr char CHUNKED_WORLD_MAGIC[4] = {'R', 'C', 'W', '1'};
+
+struct ChunkedWorldStats
+{
+    uint64_t hits;          // wanted chunks that were resident
+    uint64_t misses;        // wanted chunks that had to be requested
+    uint64_t evictions;
+    uint64_t bytesLoaded;
+    uint64_t bytesInFlight; // requested but not loaded yet
+    uint64_t readFailures;  // chunks the I/O thread could not read, filled with fog instead
+    int residentChunks;
+    int loadingChunks;
+};
+
+inline int64_t ChunkedWorld_Tell(FILE* file)
+{
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+inline bool ChunkedWorld_Seek(FILE* file, const int64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+// Writes a world file chunk by chunk: generate(cx, cy, chunk) fills every layer of
+// one chunk, so worlds far larger than memory can be produced. Cells past the
+// world edge in the last row and column of chunks are never read.
+template<typename F>
+bool ChunkedWorld_Write(const std::string& path, const int width, const int height, const Vector spawn, const int fogTexture, F&& generate)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    ChunkedWorldHeader header;
+    std::memcpy(header.magic, CHUNKED_WORLD_MAGIC, sizeof(header.magic));
+    header.width = width;
+    header.height = height;
+    header.chunkSize = CHUNK_SIZE;
+    header.spawnX = static_cast<float>(spawn.x);
+    header.spawnY = static_cast<float>(spawn.y);
+    header.fogTexture = fogTexture;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    const int chunksX = (width + CHUNK_MASK) >> CHUNK_SHIFT;
+    const int chunksY = (height + CHUNK_MASK) >> CHUNK_SHIFT;
+    auto chunk = std::make_unique<ChunkData>();
+    for (int cy = 0; cy < chunksY && ok; cy++)
+    {
+        for (int cx = 0; cx < chunksX && ok; cx++)
+        {
+            std::memset(chunk.get(), 0, sizeof(ChunkData));
+            generate(cx, cy, chunk.get());
+            ok = fwrite(chunk.get(), sizeof(ChunkData), 1, file) == 1;
+        }
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+// Tile world paged in from a world file in CHUNK_SIZE x CHUNK_SIZE chunks. Update,
+// called once per frame on the main thread, decides which chunks the camera needs
+// (everything within the view distance around the camera and around where its
+// current movement leads) and queues the missing ones for the I/O thread. Chunks
+// are only published and evicted inside Update, so lookups from the renderer
+// never race with paging as long as no view is being drawn during Update. Cells
+// of chunks that are not resident read as walls of the fog texture, so rays stop
+// there instead of waiting for the disk.
+class ChunkedWorld
+{
+public:
+    ChunkedWorld()
+    {
+        mFile = nullptr;
+        mHeader = {};
+        mChunksX = 0;
+        mChunksY = 0;
+        mFogWall = 0;
+        mFrame = 0;
+        mRevision = 0;
+        mLastPosition = {0, 0};
+        mStats = {};
+        mBytesInFlight = 0;
+        mReadFailures = 0;
+        mStopping = false;
+    }
+
+    ~ChunkedWorld()
+    {
+        Close();
+    }
+
+    ChunkedWorld(const ChunkedWorld&) = delete;
+    ChunkedWorld& operator=(const ChunkedWorld&) = delete;
+
+    // Opens a world file and starts the I/O thread. At most maxResidentBytes of chunk
+    // data are kept in memory, but never fewer chunks than cover the view distance.
+    bool Open(const std::string& path, const size_t maxResidentBytes, const double viewDistance)
+    {
+        Close();
+
+        mFile = fopen(path.c_str(), "rb");
+        if (mFile == nullptr)
+        {
+            return false;
+        }
+
+        if (fread(&mHeader, sizeof(mHeader), 1, mFile) != 1 ||
+            std::memcmp(mHeader.magic, CHUNKED_WORLD_MAGIC, sizeof(mHeader.magic)) != 0 ||
+            mHeader.chunkSize != CHUNK_SIZE || mHeader.width <= 0 || mHeader.height <= 0)
+        {
+            fclose(mFile);
+            mFile = nullptr;
+            return false;
+        }
+
+        mChunksX = (mHeader.width + CHUNK_MASK) >> CHUNK_SHIFT;
+        mChunksY = (mHeader.height + CHUNK_MASK) >> CHUNK_SHIFT;
+        mFogWall = mHeader.fogTexture + 1;
+        mLastPosition = GetSpawn();
+
+        // The wanted area around one point spans this many chunks per side, around two points twice that
+        const int span = static_cast<int>(std::ceil(2 * (viewDistance + CHUNK_PREFETCH_MARGIN) / CHUNK_SIZE)) + 1;
+        const int minimumSlots = 2 * span * span;
+        const int slotCount = std::max(static_cast<int>(maxResidentBytes / sizeof(ChunkData)), minimumSlots);
+
+        mChunkSlots.assign(static_cast<size_t>(mChunksX) * mChunksY, -1);
+        mChunkLoading.assign(static_cast<size_t>(mChunksX) * mChunksY, 0);
+        mSlots = std::make_unique<ChunkData[]>(slotCount);
+        mSlotChunks.assign(slotCount, -1);
+        mSlotLastWanted.assign(slotCount, 0);
+        mFreeSlots.clear();
+        for (int slot = slotCount - 1; slot >= 0; slot--)
+        {
+            mFreeSlots.push_back(slot);
+        }
+        mWanted.reserve(static_cast<size_t>(minimumSlots));
+        mCompleted.clear();
+        mRequests.clear();
+
+        mStopping = false;
+        mThread = std::thread(&ChunkedWorld::IoLoop, this);
+        return true;
+    }
+
+    void Close()
+    {
+        if (mThread.joinable())
+        {
+            {
+                std::lock_guard lock(mMutex);
+                mStopping = true;
+            }
+            mWake.notify_all();
+            mThread.join();
+        }
+
+        if (mFile != nullptr)
+        {
+            fclose(mFile);
+            mFile = nullptr;
+        }
+    }
+
+    int GetWidth() const { return mHeader.width; }
+    int GetHeight() const { return mHeader.height; }
+    Vector GetSpawn() const { return {mHeader.spawnX, mHeader.spawnY}; }
+
+    // Bumped whenever a chunk is published or evicted, that is whenever the world as the renderer sees it changed
+    uint64_t GetRevision() const { return mRevision; }
+
+    ChunkedWorldStats GetStats() const
+    {
+        ChunkedWorldStats stats = mStats;
+        stats.bytesInFlight = mBytesInFlight.load(std::memory_order_relaxed);
+        stats.readFailures = mReadFailures.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void Update(const Vector position, const double viewDistance)
+    {
+        PublishCompleted();
+
+        const Vector velocity = {position.x - mLastPosition.x, position.y - mLastPosition.y};
+        const Vector ahead = {position.x + velocity.x * CHUNK_LOOKAHEAD_FRAMES, position.y + velocity.y * CHUNK_LOOKAHEAD_FRAMES};
+        mLastPosition = position;
+        mFrame++;
+
+        CollectWanted(position, ahead, viewDistance + CHUNK_PREFETCH_MARGIN);
+
+        // Mark every wanted resident chunk before requesting any miss, so a request
+        // for a near chunk cannot evict a farther one that is still wanted
+        for (const auto& [distance, chunk]: mWanted)
+        {
+            const int slot = mChunkSlots[chunk];
+            if (slot >= 0)
+            {
+                mSlotLastWanted[slot] = mFrame;
+                mStats.hits++;
+            }
+        }
+
+        for (const auto& [distance, chunk]: mWanted)
+        {
+            if (mChunkSlots[chunk] < 0 && mChunkLoading[chunk] == 0)
+            {
+                mStats.misses++;
+                Request(chunk);
+            }
+        }
+    }
+
+    int GetWall(const int x, const int y) const
+    {
+        const int slot = mChunkSlots[(y >> CHUNK_SHIFT) * mChunksX + (x >> CHUNK_SHIFT)];
+        return slot < 0 ? mFogWall : mSlots[slot].walls[GetCellIndex(x, y)];
+    }
+
+    int GetFloor(const int x, const int y) const
+    {
+        const int slot = mChunkSlots[(y >> CHUNK_SHIFT) * mChunksX + (x >> CHUNK_SHIFT)];
+        return slot < 0 ? mHeader.fogTexture : mSlots[slot].floors[GetCellIndex(x, y)];
+    }
+
+    int GetCeiling(const int x, const int y) const
+    {
+        const int slot = mChunkSlots[(y >> CHUNK_SHIFT) * mChunksX + (x >> CHUNK_SHIFT)];
+        return slot < 0 ? 0 : mSlots[slot].ceilings[GetCellIndex(x, y)];
+    }
+
+    double GetLight(const int x, const int y) const
+    {
+        const int slot = mChunkSlots[(y >> CHUNK_SHIFT) * mChunksX + (x >> CHUNK_SHIFT)];
+        return slot < 0 ? 1.0 : mSlots[slot].lights[GetCellIndex(x, y)];
+    }
+
+    double GetCeilingLight(const int x, const int y) const
+    {
+        const int slot = mChunkSlots[(y >> CHUNK_SHIFT) * mChunksX + (x >> CHUNK_SHIFT)];
+        return slot < 0 ? 1.0 : mSlots[slot].ceilingLights[GetCellIndex(x, y)];
+    }
+
+private:
+    static int GetCellIndex(const int x, const int y)
+    {
+        return (x & CHUNK_MASK) << CHUNK_SHIFT | (y & CHUNK_MASK);
+    }
+
+    // Squared distance from a point to the nearest cell of a chunk
+    static double GetChunkDistanceSqr(const int cx, const int cy, const Vector point)
+    {
+        const double x0 = cx << CHUNK_SHIFT, y0 = cy << CHUNK_SHIFT;
+        const double dx = std::max({x0 - point.x, 0.0, point.x - (x0 + CHUNK_SIZE)});
+        const double dy = std::max({y0 - point.y, 0.0, point.y - (y0 + CHUNK_SIZE)});
+        return dx * dx + dy * dy;
+    }
+
+    // Chunks within radius of the camera or of the point it is heading to, nearest to the camera first
+    void CollectWanted(const Vector position, const Vector ahead, const double radius)
+    {
+        mWanted.clear();
+
+        const int cx0 = std::max(static_cast<int>(std::floor((std::min(position.x, ahead.x) - radius) / CHUNK_SIZE)), 0);
+        const int cy0 = std::max(static_cast<int>(std::floor((std::min(position.y, ahead.y) - radius) / CHUNK_SIZE)), 0);
+        const int cx1 = std::min(static_cast<int>(std::floor((std::max(position.x, ahead.x) + radius) / CHUNK_SIZE)), mChunksX - 1);
+        const int cy1 = std::min(static_cast<int>(std::floor((std::max(position.y, ahead.y) + radius) / CHUNK_SIZE)), mChunksY - 1);
+
+        for (int cy = cy0; cy <= cy1; cy++)
+        {
+            for (int cx = cx0; cx <= cx1; cx++)
+            {
+                const double distanceSqr = GetChunkDistanceSqr(cx, cy, position);
+                if (distanceSqr <= radius * radius || GetChunkDistanceSqr(cx, cy, ahead) <= radius * radius)
+                {
+                    mWanted.emplace_back(distanceSqr, cy * mChunksX + cx);
+                }
+            }
+        }
+
+        std::ranges::sort(mWanted);
+    }
+
+    // A free slot, or the slot of the resident chunk wanted least recently. -1 when
+    // every resident chunk is wanted this frame.
+    int AcquireSlot()
+    {
+        if (!mFreeSlots.empty())
+        {
+            const int slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            return slot;
+        }
+
+        int victim = -1;
+        for (int slot = 0; slot < static_cast<int>(mSlotChunks.size()); slot++)
+        {
+            const int chunk = mSlotChunks[slot];
+            if (chunk < 0 || mChunkSlots[chunk] != slot || mSlotLastWanted[slot] == mFrame) continue;
+
+            if (victim == -1 || mSlotLastWanted[slot] < mSlotLastWanted[victim])
+            {
+                victim = slot;
+            }
+        }
+
+        if (victim != -1)
+        {
+            Evict(victim);
+        }
+        return victim;
+    }
+
+    // Drops the resident chunk of a slot. Like publishing a loaded chunk, this changes
+    // what the cell lookups return, so both bump the revision. Picking a slot does not.
+    void Evict(const int slot)
+    {
+        mChunkSlots[mSlotChunks[slot]] = -1;
+        mSlotChunks[slot] = -1;
+        mStats.evictions++;
+        mStats.residentChunks--;
+        mRevision++;
+    }
+
+    void Request(const int chunk)
+    {
+        const int slot = AcquireSlot();
+        if (slot == -1)
+        {
+            return;
+        }
+
+        mSlotChunks[slot] = chunk;
+        mChunkLoading[chunk] = 1;
+        mStats.loadingChunks++;
+        mBytesInFlight.fetch_add(sizeof(ChunkData), std::memory_order_relaxed);
+
+        {
+            std::lock_guard lock(mMutex);
+            mRequests.emplace_back(chunk, slot);
+        }
+        mWake.notify_one();
+    }
+
+    void PublishCompleted()
+    {
+        std::lock_guard lock(mMutex);
+        for (const auto& [chunk, slot]: mCompleted)
+        {
+            mChunkSlots[chunk] = slot;
+            mChunkLoading[chunk] = 0;
+            mSlotLastWanted[slot] = mFrame;
+            mStats.loadingChunks--;
+            mStats.residentChunks++;
+            mStats.bytesLoaded += sizeof(ChunkData);
+            mRevision++;
+        }
+        mCompleted.clear();
+    }
+
+    void ReadChunk(const int chunk, ChunkData* data)
+    {
+        const int64_t offset = static_cast<int64_t>(sizeof(ChunkedWorldHeader)) + static_cast<int64_t>(chunk) * static_cast<int64_t>(sizeof(ChunkData));
+        if (!ChunkedWorld_Seek(mFile, offset) || fread(data, sizeof(ChunkData), 1, mFile) != 1)
+        {
+            // Counted for the main thread's stats, printing from here would stall the loads
+            mReadFailures.fetch_add(1, std::memory_order_relaxed);
+            for (int i = 0; i < CHUNK_CELLS; i++)
+            {
+                data->walls[i] = static_cast<uint16_t>(mFogWall);
+                data->floors[i] = static_cast<uint16_t>(mHeader.fogTexture);
+                data->ceilings[i] = 0;
+                data->lights[i] = 1.0f;
+                data->ceilingLights[i] = 1.0f;
+            }
+        }
+    }
+
+    void IoLoop()
+    {
+        std::unique_lock lock(mMutex);
+        while (true)
+        {
+            mWake.wait(lock, [this] { return mStopping || !mRequests.empty(); });
+            if (mStopping)
+            {
+                return;
+            }
+
+            const auto [chunk, slot] = mRequests.front();
+            mRequests.pop_front();
+
+            lock.unlock();
+            ReadChunk(chunk, &mSlots[slot]);
+            mBytesInFlight.fetch_sub(sizeof(ChunkData), std::memory_order_relaxed);
+            lock.lock();
+
+            mCompleted.emplace_back(chunk, slot);
+        }
+    }
+
+    FILE* mFile;
+    ChunkedWorldHeader mHeader;
+    int mChunksX, mChunksY;
+    int mFogWall;
+
+    // Main thread state
+    std::vector<int> mChunkSlots;      // per chunk: slot it is resident in, or -1
+    std::vector<uint8_t> mChunkLoading; // per chunk: a request is in flight
+    std::unique_ptr<ChunkData[]> mSlots;
+    std::vector<int> mSlotChunks;       // per slot: chunk it holds or is loading, or -1
+    std::vector<uint64_t> mSlotLastWanted;
+    std::vector<int> mFreeSlots;
+    std::vector<std::pair<double, int>> mWanted;
+    uint64_t mFrame;
+    uint64_t mRevision;
+    Vector mLastPosition;
+    ChunkedWorldStats mStats;
+
+    // Shared with the I/O thread
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<std::pair<int, int>> mRequests;  // (chunk, slot)
+    std::vector<std::pair<int, int>> mCompleted; // (chunk, slot)
+    std::atomic<uint64_t> mBytesInFlight;
+    std::atomic<uint64_t> mReadFailures;
+    bool mStopping;
+};
+
+// Cell lookups that work for every kind of level: the chunks of a paged world
+// when level->world is set, flat shared layers when level->grid is set, the
+// dense maps otherwise.
+inline int Level_GetWall(const Level* level, const int x, const int y)
+{
+    if (level->world != nullptr) return level->world->GetWall(x, y);
+    if (level->grid != nullptr) return level->grid->walls[x * level->grid->height + y];
+    return level->wallMap[x][y];
+}
+
+inline int Level_GetFloor(const Level* level, const int x, const int y)
+{
+    if (level->world != nullptr) return level->world->GetFloor(x, y);
+    if (level->grid != nullptr) return level->grid->floors[x * level->grid->height + y];
+    return level->floorMap[x][y];
+}
+
+inline int Level_GetCeiling(const Level* level, const int x, const int y)
+{
+    if (level->world != nullptr) return level->world->GetCeiling(x, y);
+    if (level->grid != nullptr) return level->grid->ceilings[x * level->grid->height + y];
+    return level->ceilingMap[x][y];
+}
+
+inline double Level_GetLight(const Level* level, const int x, const int y)
+{
+    if (level->world != nullptr) return level->world->GetLight(x, y);
+    if (level->grid != nullptr) return level->grid->lights[x * level->grid->height + y];
+    return level->lightMap[x][y];
+}
+
+inline double Level_GetCeilingLight(const Level* level, const int x, const int y)
+{
+    if (level->world != nullptr) return level->world->GetCeilingLight(x, y);
+    if (level->grid != nullptr) return level->grid->ceilingLights[x * level->grid->height + y];
+    return level->ceilingLightMap[x][y];
+}
+
+// Must follow every edit of a cell or light in the dense maps once the level is set up. Caches
+// built from the cell lookups, like the incremental renderer's, only notice changes through it.
+inline void Level_MarkEdited(Level* level)
+{
+    level->revision++;
+}
+
+// Changes whenever paging or an edit of the dense maps changed what the cell lookups return.
+// Both counters only grow, so their sum does too.
+inline uint64_t Level_GetRevision(const Level* level)
+{
+    return level->revision + (level->world != nullptr ? level->world->GetRevision() : 0);
+}
+
+// Converts the cells of a level into a world file.
+inline bool ChunkedWorld_WriteFromLevel(const std::string& path, const Level* level, const Vector spawn, const int fogTexture)
+{
+    return ChunkedWorld_Write(path, level->mapWidth, level->mapHeight, spawn, fogTexture, [&](const int cx, const int cy, ChunkData* chunk)
+    {
+        for (int x = 0; x < CHUNK_SIZE; x++)
+        {
+            for (int y = 0; y < CHUNK_SIZE; y++)
+            {
+                const int worldX = (cx << CHUNK_SHIFT) + x;
+                const int worldY = (cy << CHUNK_SHIFT) + y;
+                if (worldX >= level->mapWidth || worldY >= level->mapHeight) continue;
+
+                const int i = x * CHUNK_SIZE + y;
+                chunk->walls[i] = static_cast<uint16_t>(Level_GetWall(level, worldX, worldY));
+                chunk->floors[i] = static_cast<uint16_t>(Level_GetFloor(level, worldX, worldY));
+                chunk->ceilings[i] = static_cast<uint16_t>(Level_GetCeiling(level, worldX, worldY));
+                chunk->lights[i] = static_cast<float>(Level_GetLight(level, worldX, worldY));
+                chunk->ceilingLights[i] = static_cast<float>(Level_GetCeilingLight(level, worldX, worldY));
+            }
+        }
+    });
+}
+
+#endif
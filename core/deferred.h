@@ -0,0 +1,86 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+#include "include.h"
+#include "structures.h"
+#include "jobpool.h"
+
+#include <bit>
+
+// Deferred shading: the geometry passes write unshaded texels, each carrying a
+// light and fog attribute in its fourth byte, the one shading never touches.
+// One pass over the whole frame then shades every pixel the same way. The
+// attribute holds the tile light in 4 bits of 1/8 steps, like the palette's
+// colormaps, and the distance fog in 4 bits of 1/16 steps up to the 0.75 the
+// passes cap it at. A channel c then shades to c * (16 - fog) * light / 128.
+// The product stays below 2^16 and the divisor is a power of two, so the loop
+// vectorizes into 16-bit multiplies and shifts, without tables.
+
+#define DEFERRED_LIGHT_SCALE 8
+#define DEFERRED_LIGHT_LEVELS 16
+#define DEFERRED_FOG_SCALE 16
+#define DEFERRED_FOG_LEVELS 13 // 0.75 * DEFERRED_FOG_SCALE + 1
+#define DEFERRED_SHADE_SHIFT 7 // log2(DEFERRED_LIGHT_SCALE * DEFERRED_FOG_SCALE)
+#define DEFERRED_UNSHADED (DEFERRED_LIGHT_SCALE << 4) // full light and no fog, leaves the texel as it is
+#define DEFERRED_ROWS_PER_JOB 16
+
+// Bit offset of Pixel::a within Pixel::rgba, the attribute, and of the three color bytes
+inline constexpr int DEFERRED_ATTRIBUTE_SHIFT = std::endian::native == std::endian::little ? 24 : 0;
+inline constexpr int DEFERRED_COLOR_SHIFTS[3] = {
+    std::endian::native == std::endian::little ? 0 : 8,
+    std::endian::native == std::endian::little ? 8 : 16,
+    std::endian::native == std::endian::little ? 16 : 24
+};
+
+inline uint8_t Deferred_PackAttribute(const double shadingPerc, const double lightValue)
+{
+    const int light = std::clamp(static_cast<int>(lightValue * DEFERRED_LIGHT_SCALE + 0.5), 0, DEFERRED_LIGHT_LEVELS - 1);
+    const int fog = std::clamp(static_cast<int>(shadingPerc * DEFERRED_FOG_SCALE + 0.5), 0, DEFERRED_FOG_LEVELS - 1);
+    return static_cast<uint8_t>(light << 4 | fog);
+}
+
+// Shades count pixels of the attribute buffer into output. The fourth byte of
+// every output pixel is set opaque.
+inline void Deferred_ShadePixels(const uint32_t* gbuffer, uint32_t* output, const int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const uint32_t texel = gbuffer[i];
+        const auto attribute = static_cast<uint16_t>((texel >> DEFERRED_ATTRIBUTE_SHIFT) & 0xFF);
+        const auto factor = static_cast<uint16_t>((DEFERRED_FOG_SCALE - (attribute & 0xF)) * (attribute >> 4));
+
+        uint32_t shaded = 0xFFu << DEFERRED_ATTRIBUTE_SHIFT;
+        for (const int shift: DEFERRED_COLOR_SHIFTS)
+        {
+            const auto channel = static_cast<uint16_t>((texel >> shift) & 0xFF);
+            const auto value = static_cast<uint16_t>(static_cast<uint16_t>(channel * factor) >> DEFERRED_SHADE_SHIFT);
+            shaded |= static_cast<uint32_t>(std::min<uint16_t>(value, 255)) << shift;
+        }
+        output[i] = shaded;
+    }
+}
+
+// Shades a whole width * height frame in bands of rows spread across the pool,
+// or on the calling thread without one. gbuffer and output may be the same buffer.
+inline void Deferred_Shade(const uint32_t* gbuffer, uint32_t* output, const int width, const int height, JobPool* pool)
+{
+    const int bandCount = (height + DEFERRED_ROWS_PER_JOB - 1) / DEFERRED_ROWS_PER_JOB;
+    const auto shadeBand = [&](const int band, int)
+    {
+        const int firstRow = band * DEFERRED_ROWS_PER_JOB;
+        const int rows = std::min(DEFERRED_ROWS_PER_JOB, height - firstRow);
+        const size_t offset = static_cast<size_t>(firstRow) * width;
+        Deferred_ShadePixels(gbuffer + offset, output + offset, rows * width);
+    };
+
+    if (pool == nullptr)
+    {
+        for (int band = 0; band < bandCount; band++)
+        {
+            shadeBand(band, 0);
+        }
+        return;
+    }
+    pool->ParallelFor(bandCount, shadeBand);
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef DEPTH_HIERARCHY_H
+#define DEPTH_HIERARCHY_H
+#include "include.h"
+
+// Min/max segment tree over a per-column depth buffer (the wall ZBuffer).
+// Leaves live at [leafCount, leafCount + width), node i covers the union of
+// nodes 2i and 2i + 1. Anything drawn at depth d in column x is hidden when
+// d >= depth[x], so a whole column range can be rejected with one max query.
+struct DepthHierarchy
+{
+    int width;
+    int leafCount;
+    std::vector<double> minDepth;
+    std::vector<double> maxDepth;
+};
+
+inline void DepthHierarchy_Build(DepthHierarchy* hierarchy, const double* depths, const int width)
+{
+    int leafCount = 1;
+    while (leafCount < width)
+    {
+        leafCount <<= 1;
+    }
+
+    hierarchy->width = width;
+    hierarchy->leafCount = leafCount;
+    hierarchy->minDepth.resize(leafCount * 2);
+    hierarchy->maxDepth.resize(leafCount * 2);
+
+    for (int x = 0; x < leafCount; x++)
+    {
+        // Padding leaves never occlude and are never visible, queries are clamped to width anyway
+        const double depth = x < width ? depths[x] : 0.0;
+        hierarchy->minDepth[leafCount + x] = depth;
+        hierarchy->maxDepth[leafCount + x] = depth;
+    }
+
+    for (int node = leafCount - 1; node > 0; node--)
+    {
+        hierarchy->minDepth[node] = std::min(hierarchy->minDepth[2 * node], hierarchy->minDepth[2 * node + 1]);
+        hierarchy->maxDepth[node] = std::max(hierarchy->maxDepth[2 * node], hierarchy->maxDepth[2 * node + 1]);
+    }
+}
+
+// Largest depth in the columns [from, to), or 0 for an empty range.
+inline double DepthHierarchy_RangeMax(const DepthHierarchy* hierarchy, int from, int to)
+{
+    from = std::max(from, 0);
+    to = std::min(to, hierarchy->width);
+
+    double result = 0.0;
+    for (int lo = from + hierarchy->leafCount, hi = to + hierarchy->leafCount; lo < hi; lo >>= 1, hi >>= 1)
+    {
+        if (lo & 1) result = std::max(result, hierarchy->maxDepth[lo++]);
+        if (hi & 1) result = std::max(result, hierarchy->maxDepth[--hi]);
+    }
+    return result;
+}
+
+// Smallest depth in the columns [from, to), or DBL_MAX for an empty range.
+inline double DepthHierarchy_RangeMin(const DepthHierarchy* hierarchy, int from, int to)
+{
+    from = std::max(from, 0);
+    to = std::min(to, hierarchy->width);
+
+    double result = std::numeric_limits<double>::max();
+    for (int lo = from + hierarchy->leafCount, hi = to + hierarchy->leafCount; lo < hi; lo >>= 1, hi >>= 1)
+    {
+        if (lo & 1) result = std::min(result, hierarchy->minDepth[lo++]);
+        if (hi & 1) result = std::min(result, hierarchy->minDepth[--hi]);
+    }
+    return result;
+}
+
+// True when something at the given depth would be hidden in every column of [from, to).
+inline bool DepthHierarchy_IsOccluded(const DepthHierarchy* hierarchy, const int from, const int to, const double depth)
+{
+    return DepthHierarchy_RangeMax(hierarchy, from, to) <= depth;
+}
+
+inline int DepthHierarchy_FindFirst(const DepthHierarchy* hierarchy, const int node, const int nodeFrom, const int nodeTo,
+                                    const int from, const int to, const double depth, const bool visible)
+{
+    if (nodeTo <= from || nodeFrom >= to)
+    {
+        return -1;
+    }
+
+    // Prune subtrees that cannot contain a match
+    if (visible ? hierarchy->maxDepth[node] <= depth : hierarchy->minDepth[node] > depth)
+    {
+        return -1;
+    }
+
+    if (nodeTo - nodeFrom == 1)
+    {
+        return nodeFrom;
+    }
+
+    const int mid = (nodeFrom + nodeTo) / 2;
+    const int left = DepthHierarchy_FindFirst(hierarchy, 2 * node, nodeFrom, mid, from, to, depth, visible);
+    if (left != -1)
+    {
+        return left;
+    }
+    return DepthHierarchy_FindFirst(hierarchy, 2 * node + 1, mid, nodeTo, from, to, depth, visible);
+}
+
+// First column in [from, to) where something at the given depth is in front of the wall, or `to` if there is none.
+inline int DepthHierarchy_FindFirstVisible(const DepthHierarchy* hierarchy, const int from, int to, const double depth)
+{
+    to = std::min(to, hierarchy->width);
+    const int column = DepthHierarchy_FindFirst(hierarchy, 1, 0, hierarchy->leafCount, std::max(from, 0), to, depth, true);
+    return column == -1 ? std::max(to, from) : column;
+}
+
+// First column in [from, to) where something at the given depth is behind the wall, or `to` if there is none.
+inline int DepthHierarchy_FindFirstHidden(const DepthHierarchy* hierarchy, const int from, int to, const double depth)
+{
+    to = std::min(to, hierarchy->width);
+    const int column = DepthHierarchy_FindFirst(hierarchy, 1, 0, hierarchy->leafCount, std::max(from, 0), to, depth, false);
+    return column == -1 ? std::max(to, from) : column;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+#include "include.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMEBUFFER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Edge of the square tiles the transpose walks, small enough that a tile of the
+// source and of the destination both stay in L1
+#define FRAMEBUFFER_TRANSPOSE_TILE 32
+
+// Pixel layouts the passes can be instantiated with. Row-major is what SDL
+// textures expect. Column-major keeps the pixels of one screen column
+// contiguous, which is how walls and sprites are drawn.
+struct RowMajorLayout
+{
+    int width, height;
+
+    int Index(const int x, const int y) const { return y * width + x; }
+};
+
+struct ColumnMajorLayout
+{
+    int width, height;
+
+    int Index(const int x, const int y) const { return x * height + y; }
+};
+
+template<typename T>
+void Framebuffer_TransposeTile(const T* columns, T* rows, const int width, const int height, const int x0, const int y0, const int x1, const int y1)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            rows[y * width + x] = columns[x * height + y];
+        }
+    }
+}
+
+#ifdef FRAMEBUFFER_SSE2
+// 32-bit pixels are moved as 4x4 blocks in SSE registers, leftover edges go through the scalar tile.
+inline void Framebuffer_TransposeTile(const uint32_t* columns, uint32_t* rows, const int width, const int height, const int x0, const int y0, const int x1, const int y1)
+{
+    const int blockX1 = x0 + (x1 - x0) / 4 * 4;
+    const int blockY1 = y0 + (y1 - y0) / 4 * 4;
+
+    for (int x = x0; x < blockX1; x += 4)
+    {
+        for (int y = y0; y < blockY1; y += 4)
+        {
+            const __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + (x + 0) * height + y));
+            const __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + (x + 1) * height + y));
+            const __m128i c2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + (x + 2) * height + y));
+            const __m128i c3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + (x + 3) * height + y));
+
+            const __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+            const __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+            const __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+            const __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + (y + 0) * width + x), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + (y + 1) * width + x), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + (y + 2) * width + x), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + (y + 3) * width + x), _mm_unpackhi_epi64(t2, t3));
+        }
+    }
+
+    Framebuffer_TransposeTile<uint32_t>(columns, rows, width, height, blockX1, y0, x1, y1);
+    Framebuffer_TransposeTile<uint32_t>(columns, rows, width, height, x0, blockY1, blockX1, y1);
+}
+
+// Indexed pixels are moved as 16x16 blocks: four rounds of interleaving pairs of
+// registers, with element sizes of 1, 2, 4 and 8 bytes, leave row r of the block
+// in register bitreverse(r).
+inline void Framebuffer_TransposeTile(const uint8_t* columns, uint8_t* rows, const int width, const int height, const int x0, const int y0, const int x1, const int y1)
+{
+    constexpr int rowOfRegister[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+
+    const int blockX1 = x0 + (x1 - x0) / 16 * 16;
+    const int blockY1 = y0 + (y1 - y0) / 16 * 16;
+
+    for (int x = x0; x < blockX1; x += 16)
+    {
+        for (int y = y0; y < blockY1; y += 16)
+        {
+            __m128i a[16], b[16];
+            for (int i = 0; i < 16; i++)
+            {
+                a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + (x + i) * height + y));
+            }
+
+            for (int i = 0; i < 8; i++)
+            {
+                b[i] = _mm_unpacklo_epi8(a[2 * i], a[2 * i + 1]);
+                b[i + 8] = _mm_unpackhi_epi8(a[2 * i], a[2 * i + 1]);
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                a[i] = _mm_unpacklo_epi16(b[2 * i], b[2 * i + 1]);
+                a[i + 8] = _mm_unpackhi_epi16(b[2 * i], b[2 * i + 1]);
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                b[i] = _mm_unpacklo_epi32(a[2 * i], a[2 * i + 1]);
+                b[i + 8] = _mm_unpackhi_epi32(a[2 * i], a[2 * i + 1]);
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                a[i] = _mm_unpacklo_epi64(b[2 * i], b[2 * i + 1]);
+                a[i + 8] = _mm_unpackhi_epi64(b[2 * i], b[2 * i + 1]);
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + (y + rowOfRegister[i]) * width + x), a[i]);
+            }
+        }
+    }
+
+    Framebuffer_TransposeTile<uint8_t>(columns, rows, width, height, blockX1, y0, x1, y1);
+    Framebuffer_TransposeTile<uint8_t>(columns, rows, width, height, x0, blockY1, blockX1, y1);
+}
+#endif
+
+// Copies a column-major width * height framebuffer into a row-major one, tile by tile.
+template<typename T>
+void Framebuffer_Transpose(const T* columns, T* rows, const int width, const int height)
+{
+    for (int y = 0; y < height; y += FRAMEBUFFER_TRANSPOSE_TILE)
+    {
+        for (int x = 0; x < width; x += FRAMEBUFFER_TRANSPOSE_TILE)
+        {
+            Framebuffer_TransposeTile(columns, rows, width, height, x, y,
+                                      std::min(x + FRAMEBUFFER_TRANSPOSE_TILE, width), std::min(y + FRAMEBUFFER_TRANSPOSE_TILE, height));
+        }
+    }
+}
+
+#endif
@@ -11,6 +11,12 @@
 #include <algorithm>
 #include <limits>
 
+inline void EXIT_LOG_ERROR(const std::string &message)
+{
+    printf("%s\n", message.c_str());
+    exit(1);
+}
+
 inline void EXIT_LOG_SDL_ERROR(const std::string &message)
 {
     printf("%s %s\n", message.c_str(), SDL_GetError());
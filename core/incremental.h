@@ -0,0 +1,173 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+#include "include.h"
+#include "renderer.h"
+
+#include <cstring>
+
+// What the incremental renderer keeps of the last frame it drew: the state it
+// was drawn from (camera, level revision and things), the background without
+// sprites, the ZBuffer and the finished frame.
+struct IncrementalCache
+{
+    bool valid;
+    int width, height;
+    int pixelSize;
+    Camera camera;
+    std::vector<Thing> things;
+    uint64_t levelRevision;
+    std::vector<double> zBuffer;
+    std::vector<uint8_t> background;
+    std::vector<uint8_t> frame;
+
+    int redrawnColumns; // columns drawn by the last update, width when it was a full redraw
+};
+
+inline void IncrementalCache_Invalidate(IncrementalCache* cache)
+{
+    cache->valid = false;
+}
+
+inline bool Incremental_IsSameCamera(const Camera& a, const Camera& b)
+{
+    return a.position.x == b.position.x && a.position.y == b.position.y &&
+           a.direction.x == b.direction.x && a.direction.y == b.direction.y &&
+           a.plane.x == b.plane.x && a.plane.y == b.plane.y;
+}
+
+inline bool Incremental_IsSameThing(const Thing& a, const Thing& b)
+{
+    return a.position.x == b.position.x && a.position.y == b.position.y && a.textureIndex == b.textureIndex;
+}
+
+// Anything that changes every column: the camera, edited cells or lights, paged in or evicted chunks or the set of things.
+inline bool Incremental_NeedsFullRedraw(const IncrementalCache* cache, const Level* level, const Camera* camera)
+{
+    return !cache->valid ||
+           !Incremental_IsSameCamera(cache->camera, *camera) ||
+           static_cast<int>(cache->things.size()) != level->thingCount ||
+           cache->levelRevision != Level_GetRevision(level);
+}
+
+// False when the last frame drawn from this cache is still exactly what the view shows.
+inline bool Incremental_HasChanged(const IncrementalCache* cache, const Level* level, const Camera* camera)
+{
+    if (Incremental_NeedsFullRedraw(cache, level, camera))
+    {
+        return true;
+    }
+
+    for (int i = 0; i < level->thingCount; i++)
+    {
+        if (!Incremental_IsSameThing(cache->things[i], level->things[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int Incremental_MarkSpriteColumns(const Camera* camera, const Vector position, const int width, const int height, uint8_t* dirty)
+{
+    SpriteProjection projection;
+    if (!Renderer_ProjectSprite(camera, position, width, height, &projection))
+    {
+        return 0;
+    }
+
+    int marked = 0;
+    for (int x = projection.drawStartX; x < projection.drawEndX; x++)
+    {
+        marked += dirty[x] == 0;
+        dirty[x] = 1;
+    }
+    return marked;
+}
+
+// Brings buffer up to date with the least work the changes allow. A moved camera,
+// changed lights, paging or a different set of things redraw everything. With only things
+// moved or retextured, the columns they covered before and cover now are restored
+// from the cached background and get their sprites drawn again, against the
+// cached ZBuffer. Returns false when nothing had to be drawn, buffer still
+// receives the cached frame then.
+template<typename Shader>
+bool Renderer_DrawViewIncremental(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                                  RenderScratch* scratch, IncrementalCache* cache)
+{
+    using Output = typename Shader::Output;
+
+    const size_t frameBytes = static_cast<size_t>(width) * height * sizeof(Output);
+    const bool sameFormat = cache->width == width && cache->height == height && cache->pixelSize == static_cast<int>(sizeof(Output));
+
+    if (!sameFormat || Incremental_NeedsFullRedraw(cache, level, camera))
+    {
+        double* zBuffer = FrameArena_AllocArray<double>(&scratch->arena, width);
+        RayHit* hits = FrameArena_AllocArray<RayHit>(&scratch->arena, width);
+
+        std::fill_n(buffer, width * height, 0);
+
+        const uint8_t* castColumns = Renderer_CastViewWalls(level, camera, width, hits, zBuffer, scratch);
+        RENDER_STATS_RAYS(scratch->stats, camera->position, hits, width, castColumns);
+        Renderer_DrawSky(shader, level, camera, buffer, width, height, nullptr, scratch->stats);
+        Renderer_DrawFloorAndCeiling(shader, level, camera, buffer, width, height, nullptr, scratch->stats);
+        Renderer_DrawWalls(shader, level, camera, buffer, width, height, hits, nullptr, scratch->stats);
+
+        cache->background.resize(frameBytes);
+        std::memcpy(cache->background.data(), buffer, frameBytes);
+        cache->zBuffer.assign(zBuffer, zBuffer + width);
+
+        DepthHierarchy_Build(&scratch->depthHierarchy, zBuffer, width);
+        Renderer_DrawSprites(shader, level, camera, buffer, width, height, scratch);
+
+        cache->frame.resize(frameBytes);
+        std::memcpy(cache->frame.data(), buffer, frameBytes);
+        cache->camera = *camera;
+        cache->things.assign(level->things, level->things + level->thingCount);
+        cache->levelRevision = Level_GetRevision(level);
+        cache->width = width;
+        cache->height = height;
+        cache->pixelSize = sizeof(Output);
+        cache->valid = true;
+        cache->redrawnColumns = width;
+        return true;
+    }
+
+    uint8_t* dirty = FrameArena_AllocArray<uint8_t>(&scratch->arena, width);
+    std::fill_n(dirty, width, 0);
+
+    int dirtyColumns = 0;
+    for (int i = 0; i < level->thingCount; i++)
+    {
+        if (Incremental_IsSameThing(cache->things[i], level->things[i])) continue;
+
+        dirtyColumns += Incremental_MarkSpriteColumns(camera, cache->things[i].position, width, height, dirty);
+        dirtyColumns += Incremental_MarkSpriteColumns(camera, level->things[i].position, width, height, dirty);
+    }
+
+    cache->things.assign(level->things, level->things + level->thingCount);
+    cache->redrawnColumns = dirtyColumns;
+
+    const auto frame = reinterpret_cast<Output*>(cache->frame.data());
+    if (dirtyColumns > 0)
+    {
+        const auto background = reinterpret_cast<const Output*>(cache->background.data());
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                if (dirty[x])
+                {
+                    frame[y * width + x] = background[y * width + x];
+                }
+            }
+        }
+
+        DepthHierarchy_Build(&scratch->depthHierarchy, cache->zBuffer.data(), width);
+        Renderer_DrawSprites(shader, level, camera, frame, width, height, scratch, dirty);
+    }
+
+    std::memcpy(buffer, frame, frameBytes);
+    return dirtyColumns > 0;
+}
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef INTERLACE_H
+#define INTERLACE_H
+#include "include.h"
+#include "renderer.h"
+
+#include <cstring>
+
+// Relative depth mismatch between where a surface is expected in the previous
+// frame and what that frame's ZBuffer saw, above which a column counts as disoccluded
+#define INTERLACE_DEPTH_TOLERANCE 0.05
+
+// What the interlaced renderer keeps of the previous frame: its background
+// (everything except sprites, which are always drawn fresh), its ZBuffer and
+// the camera it was rendered with. Only columns that were cast and drawn may
+// serve as a source, reprojecting a reprojected column would compound its error.
+struct InterlaceHistory
+{
+    bool valid = false;
+    int frame = 0;
+    int width = 0, height = 0;
+    int pixelSize = 0;
+    Camera camera;
+    std::vector<double> zBuffer;
+    std::vector<uint8_t> background;
+    std::vector<uint8_t> castColumns;
+
+    int reprojectedColumns = 0; // columns filled from the previous frame in the last frame
+};
+
+inline void InterlaceHistory_Invalidate(InterlaceHistory* history)
+{
+    history->valid = false;
+}
+
+// The previous-frame column that saw the surface column x is expected to show at
+// the given depth, or -1 when it cannot be reused (off screen, behind the old
+// camera, or something else was in front of it back then).
+inline int Interlace_FindSourceColumn(const InterlaceHistory* history, const Camera* camera, const int x, const int width, const double depth)
+{
+    const Vector rayDirection = Renderer_GetRayDirection(camera, x, width);
+    const Camera& previous = history->camera;
+    const Vector relative = {
+        camera->position.x + rayDirection.x * depth - previous.position.x,
+        camera->position.y + rayDirection.y * depth - previous.position.y
+    };
+
+    // Same projection as the sprites use
+    const double invDet = 1.0 / (previous.plane.x * previous.direction.y - previous.direction.x * previous.plane.y);
+    const Vector transform = {
+        invDet * (previous.direction.y * relative.x - previous.direction.x * relative.y),
+        invDet * (-previous.plane.y * relative.x + previous.plane.x * relative.y)
+    };
+
+    if (transform.y <= 0)
+    {
+        return -1;
+    }
+
+    // Nearest cast column, the skipped ones hold reprojected pixels themselves
+    const double sourceColumn = width / 2.0 * (1 + transform.x / transform.y);
+    int source = static_cast<int>(std::lround(sourceColumn));
+    if (source >= 0 && source < width && !history->castColumns[source])
+    {
+        source += sourceColumn < source ? -1 : 1;
+    }
+    if (source < 0 || source >= width || !history->castColumns[source])
+    {
+        return -1;
+    }
+
+    if (std::abs(history->zBuffer[source] - transform.y) > INTERLACE_DEPTH_TOLERANCE * transform.y)
+    {
+        return -1;
+    }
+
+    return source;
+}
+
+// True when the rays of both columns stopped on the same wall plane.
+inline bool Interlace_IsSamePlane(const RayHit& a, const RayHit& b)
+{
+    if (!a.hit || !b.hit || a.side != b.side)
+    {
+        return false;
+    }
+    return a.side == 0 ? a.cell.x == b.cell.x : a.cell.y == b.cell.y;
+}
+
+// Bottom row of the wall every column of the previous frame showed, below which it saw floor
+// and mirrored above which it saw ceiling. Cast columns only, -1 elsewhere.
+inline void Interlace_GetSourceFloorStarts(const InterlaceHistory* history, const int width, const int height, int* floorStarts)
+{
+    for (int x = 0; x < width; x++)
+    {
+        floorStarts[x] = -1;
+        if (!history->castColumns[x]) continue;
+
+        int lineHeight, drawStart, drawEnd;
+        Renderer_GetWallSpan(height, history->zBuffer[x], &lineHeight, &drawStart, &drawEnd);
+        floorStarts[x] = std::max(height / 2, std::max(drawEnd, height - drawStart));
+    }
+}
+
+// Copies the floor and ceiling of column x, the rows outside the wall span ending
+// at floorStart, from where the previous frame saw the same floor point. Row y
+// sees the floor at positionZ / p along the ray, p = y - height / 2, which in the
+// previous camera's space is a + b * positionZ / p. Scaled by p, both coordinates
+// step linearly down the column, so each row costs a single division. False as
+// soon as a row has no source in a cast column of the previous frame, the column
+// is then left for the floor pass.
+template<typename Output>
+bool Interlace_ReprojectFloor(const InterlaceHistory* history, const int* sourceFloorStarts, const Level* level, const Camera* camera, Output* buffer,
+                              const int x, const int width, const int height, const int floorStart, RenderStats* stats)
+{
+    const Camera& previous = history->camera;
+    const auto source = reinterpret_cast<const Output*>(history->background.data());
+    const Vector rayDirection = Renderer_GetRayDirection(camera, x, width);
+    const Vector relative = {camera->position.x - previous.position.x, camera->position.y - previous.position.y};
+
+    const double invDet = 1.0 / (previous.plane.x * previous.direction.y - previous.direction.x * previous.plane.y);
+    const Vector a = {
+        invDet * (previous.direction.y * relative.x - previous.direction.x * relative.y),
+        invDet * (-previous.plane.y * relative.x + previous.plane.x * relative.y)
+    };
+    const Vector b = {
+        invDet * (previous.direction.y * rayDirection.x - previous.direction.x * rayDirection.y),
+        invDet * (-previous.plane.y * rayDirection.x + previous.plane.x * rayDirection.y)
+    };
+    const double positionZ = 0.5 * height;
+
+    int runEnd = floorStart;
+    bool hasCeiling = false;
+    for (int y = floorStart; y < height; y++)
+    {
+        const int p = std::max(y - height / 2, 1);
+        const Vector scaled = {a.x * p + b.x * positionZ, a.y * p + b.y * positionZ};
+        if (scaled.y <= 0)
+        {
+            return false;
+        }
+
+        // Nearest cast column, the skipped ones hold reprojected pixels themselves
+        const double invDepth = 1.0 / scaled.y;
+        const double sourceColumn = width / 2.0 * (1 + scaled.x * invDepth) + 0.5;
+        if (sourceColumn < 0 || sourceColumn >= width)
+        {
+            return false;
+        }
+        int sourceX = static_cast<int>(sourceColumn);
+        if (sourceFloorStarts[sourceX] < 0)
+        {
+            sourceX = sourceColumn - sourceX < 0.5 ? sourceX - 1 : sourceX + 1;
+            if (sourceX < 0 || sourceX >= width || sourceFloorStarts[sourceX] < 0)
+            {
+                return false;
+            }
+        }
+
+        const int sourceY = height / 2 + static_cast<int>(positionZ * p * invDepth + 0.5);
+        if (sourceY < sourceFloorStarts[sourceX] || sourceY >= height)
+        {
+            return false;
+        }
+
+        buffer[y * width + x] = source[sourceY * width + sourceX];
+        RENDER_STATS_PIXEL(stats, RENDER_PASS_REPROJECTION, y * width + x);
+
+        // The ceiling above the same floor point, or the sky already drawn there. Looked
+        // up once per run of rows on the same cell, found as in the column-major floor pass.
+        if (y >= runEnd)
+        {
+            const double distance = positionZ / p;
+            const IVector worldCell = {
+                static_cast<int>(std::floor(camera->position.x + rayDirection.x * distance)),
+                static_cast<int>(std::floor(camera->position.y + rayDirection.y * distance))
+            };
+            const double entryDistance = std::max(Renderer_GetCellEntryDistance(camera->position.x, rayDirection.x, worldCell.x),
+                                                  Renderer_GetCellEntryDistance(camera->position.y, rayDirection.y, worldCell.y));
+            runEnd = height;
+            if (entryDistance > 0)
+            {
+                runEnd = std::max(y + 1, static_cast<int>(std::min(std::floor(positionZ / entryDistance) + height / 2 + 1, static_cast<double>(height))));
+            }
+            hasCeiling = Level_GetCeiling(level, PosMod(worldCell.x, level->mapWidth), PosMod(worldCell.y, level->mapHeight)) > 0;
+        }
+        if (hasCeiling)
+        {
+            buffer[(height - y - 1) * width + x] = source[(height - sourceY - 1) * width + sourceX];
+            RENDER_STATS_PIXEL(stats, RENDER_PASS_REPROJECTION, (height - y - 1) * width + x);
+        }
+    }
+    return true;
+}
+
+// Renders every other column, alternating between even and odd columns each
+// frame. A skipped column whose neighbours hit the same wall plane gets its depth
+// interpolated from them (1/depth is linear across the screen) and its wall span
+// is copied from the previous frame's column that saw that point, rescaled
+// vertically for the depth change. Its floor and ceiling are reprojected pixel by
+// pixel, or drawn fresh when any of them has no source. The sky is always drawn.
+// Columns without a trustworthy wall source are redrawn in full.
+template<typename Shader>
+void Renderer_DrawViewInterlaced(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                                 RenderScratch* scratch, InterlaceHistory* history)
+{
+    using Output = typename Shader::Output;
+
+    double* zBuffer = FrameArena_AllocArray<double>(&scratch->arena, width);
+    RayHit* hits = FrameArena_AllocArray<RayHit>(&scratch->arena, width);
+    uint8_t* drawn = FrameArena_AllocArray<uint8_t>(&scratch->arena, width);
+    uint8_t* forced = FrameArena_AllocArray<uint8_t>(&scratch->arena, width);
+    int* sources = FrameArena_AllocArray<int>(&scratch->arena, width);
+
+    const bool reuse = history->valid && history->width == width && history->height == height && history->pixelSize == static_cast<int>(sizeof(Output));
+    const int parity = history->frame & 1;
+    history->frame++;
+
+    for (int x = 0; x < width; x++)
+    {
+        drawn[x] = !reuse || (x & 1) == parity;
+        forced[x] = 0;
+    }
+
+    Renderer_CastWalls(level, camera, width, hits, zBuffer, drawn);
+
+    int reprojected = 0;
+    for (int x = 0; x < width; x++)
+    {
+        if (drawn[x]) continue;
+
+        int source = -1;
+        if (x > 0 && x < width - 1 && Interlace_IsSamePlane(hits[x - 1], hits[x + 1]))
+        {
+            const double depth = 2.0 / (1.0 / zBuffer[x - 1] + 1.0 / zBuffer[x + 1]);
+            source = Interlace_FindSourceColumn(history, camera, x, width, depth);
+            zBuffer[x] = depth;
+        }
+
+        if (source == -1)
+        {
+            forced[x] = 1;
+            drawn[x] = 1;
+        }
+        else
+        {
+            sources[x] = source;
+            reprojected++;
+        }
+    }
+
+    Renderer_CastWalls(level, camera, width, hits, zBuffer, forced);
+    RENDER_STATS_RAYS(scratch->stats, camera->position, hits, width, drawn);
+
+    std::fill_n(buffer, width * height, 0);
+    Renderer_DrawSky(shader, level, camera, buffer, width, height, nullptr, scratch->stats);
+
+    // Reprojected columns whose floor and ceiling cannot be reprojected join the drawn ones in the floor pass
+    uint8_t* floorColumns = FrameArena_AllocArray<uint8_t>(&scratch->arena, width);
+    std::copy_n(drawn, width, floorColumns);
+    if (reprojected > 0)
+    {
+        int* sourceFloorStarts = FrameArena_AllocArray<int>(&scratch->arena, width);
+        Interlace_GetSourceFloorStarts(history, width, height, sourceFloorStarts);
+        for (int x = 0; x < width; x++)
+        {
+            if (drawn[x]) continue;
+
+            int lineHeight, drawStart, drawEnd;
+            Renderer_GetWallSpan(height, zBuffer[x], &lineHeight, &drawStart, &drawEnd);
+            const int floorStart = std::max(height / 2, std::max(drawEnd, height - drawStart));
+            floorColumns[x] = !Interlace_ReprojectFloor(history, sourceFloorStarts, level, camera, buffer, x, width, height, floorStart, scratch->stats);
+        }
+    }
+
+    Renderer_DrawFloorAndCeiling(shader, level, camera, buffer, width, height, floorColumns, scratch->stats);
+    Renderer_DrawWalls(shader, level, camera, buffer, width, height, hits, drawn, scratch->stats);
+
+    const auto previous = reinterpret_cast<const Output*>(history->background.data());
+    for (int x = 0; x < width; x++)
+    {
+        if (drawn[x]) continue;
+
+        const int source = sources[x];
+        int lineHeight, drawStart, drawEnd;
+        Renderer_GetWallSpan(height, zBuffer[x], &lineHeight, &drawStart, &drawEnd);
+        int sourceLineHeight, sourceStart, sourceEnd;
+        Renderer_GetWallSpan(height, history->zBuffer[source], &sourceLineHeight, &sourceStart, &sourceEnd);
+        if (sourceEnd <= sourceStart) continue;
+
+        const double scale = zBuffer[x] / history->zBuffer[source];
+        for (int y = drawStart; y < drawEnd; y++)
+        {
+            const int sourceY = std::clamp(static_cast<int>(height / 2 + (y - height / 2) * scale), sourceStart, sourceEnd - 1);
+            buffer[y * width + x] = previous[sourceY * width + source];
+            RENDER_STATS_PIXEL(scratch->stats, RENDER_PASS_REPROJECTION, y * width + x);
+        }
+    }
+
+    history->background.resize(static_cast<size_t>(width) * height * sizeof(Output));
+    std::memcpy(history->background.data(), buffer, history->background.size());
+    history->zBuffer.assign(zBuffer, zBuffer + width);
+    history->castColumns.assign(drawn, drawn + width);
+    history->camera = *camera;
+    history->width = width;
+    history->height = height;
+    history->pixelSize = sizeof(Output);
+    history->valid = true;
+    history->reprojectedColumns = reprojected;
+
+    DepthHierarchy_Build(&scratch->depthHierarchy, zBuffer, width);
+    Renderer_DrawSprites(shader, level, camera, buffer, width, height, scratch);
+}
+
+#endif
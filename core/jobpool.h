@@ -0,0 +1,143 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+#include "include.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads that run index ranges in parallel. The calling
+// thread takes part as worker 0, so a pool of one thread runs everything inline.
+// Jobs are type-erased through a function pointer rather than std::function so
+// dispatching a batch never allocates. Only one thread may dispatch at a time.
+class JobPool
+{
+public:
+    explicit JobPool(const int threadCount = static_cast<int>(std::thread::hardware_concurrency()))
+    {
+        mThreadCount = std::max(threadCount, 1);
+        mInvoke = nullptr;
+        mContext = nullptr;
+        mCount = 0;
+        mNext = 0;
+        mActive = 0;
+        mGeneration = 0;
+        mStopping = false;
+
+        for (int worker = 1; worker < mThreadCount; worker++)
+        {
+            mWorkers.emplace_back(&JobPool::WorkerLoop, this, worker);
+        }
+    }
+
+    ~JobPool()
+    {
+        {
+            std::lock_guard lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+
+        for (auto& worker: mWorkers)
+        {
+            worker.join();
+        }
+    }
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    int GetThreadCount() const
+    {
+        return mThreadCount;
+    }
+
+    // Calls job(index, worker) for every index in [0, count) and returns once all calls finished.
+    // worker is in [0, GetThreadCount()) and can be used to pick per-thread scratch memory.
+    template<typename F>
+    void ParallelFor(const int count, F&& job)
+    {
+        if (count <= 0)
+        {
+            return;
+        }
+
+        if (mThreadCount == 1 || count == 1)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                job(i, 0);
+            }
+            return;
+        }
+
+        using Job = std::remove_reference_t<F>;
+
+        std::unique_lock lock(mMutex);
+        mInvoke = [](void* context, const int index, const int worker) { (*static_cast<Job*>(context))(index, worker); };
+        mContext = const_cast<void*>(static_cast<const void*>(std::addressof(job)));
+        mCount = count;
+        mNext = 0;
+        mActive = mThreadCount - 1;
+        mGeneration++;
+        lock.unlock();
+        mWake.notify_all();
+
+        RunJobs(0);
+
+        lock.lock();
+        mDone.wait(lock, [this] { return mActive == 0; });
+    }
+
+private:
+    void RunJobs(const int worker)
+    {
+        for (int index = mNext.fetch_add(1); index < mCount; index = mNext.fetch_add(1))
+        {
+            mInvoke(mContext, index, worker);
+        }
+    }
+
+    void WorkerLoop(const int worker)
+    {
+        uint64_t seenGeneration = 0;
+
+        while (true)
+        {
+            std::unique_lock lock(mMutex);
+            mWake.wait(lock, [&] { return mStopping || mGeneration != seenGeneration; });
+            if (mStopping)
+            {
+                return;
+            }
+            seenGeneration = mGeneration;
+            lock.unlock();
+
+            RunJobs(worker);
+
+            lock.lock();
+            if (--mActive == 0)
+            {
+                mDone.notify_one();
+            }
+        }
+    }
+
+    int mThreadCount;
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+
+    void (*mInvoke)(void*, int, int);
+    void* mContext;
+    int mCount;
+    std::atomic<int> mNext;
+    int mActive;
+    uint64_t mGeneration;
+    bool mStopping;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include "include.h"
+
+// Input-to-photon latency: the time from an input event's SDL timestamp to the
+// return of the SDL_RenderPresent that first showed its effect. SDL stamps events
+// in SDL_GetTicks milliseconds, so that is the resolution of the histogram.
+
+#define LATENCY_HISTOGRAM_BUCKETS 64 // one per millisecond, the last one also takes everything longer
+#define LATENCY_MAX_PENDING_EVENTS 64
+
+struct LatencyHistogram
+{
+    uint32_t counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t total;
+    uint32_t maxMilliseconds;
+};
+
+// Timestamps of the input events handled since the last present.
+struct PendingInput
+{
+    Uint32 timestamps[LATENCY_MAX_PENDING_EVENTS];
+    int count;
+};
+
+inline void LatencyHistogram_Clear(LatencyHistogram* histogram)
+{
+    *histogram = {};
+}
+
+inline void LatencyHistogram_Add(LatencyHistogram* histogram, const uint32_t milliseconds)
+{
+    histogram->counts[std::min<uint32_t>(milliseconds, LATENCY_HISTOGRAM_BUCKETS - 1)]++;
+    histogram->total++;
+    histogram->maxMilliseconds = std::max(histogram->maxMilliseconds, milliseconds);
+}
+
+inline void LatencyHistogram_Merge(LatencyHistogram* total, const LatencyHistogram* histogram)
+{
+    for (int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+    {
+        total->counts[bucket] += histogram->counts[bucket];
+    }
+    total->total += histogram->total;
+    total->maxMilliseconds = std::max(total->maxMilliseconds, histogram->maxMilliseconds);
+}
+
+// Smallest latency at or below which the given fraction of the samples lie.
+inline uint32_t LatencyHistogram_GetPercentile(const LatencyHistogram* histogram, const double fraction)
+{
+    const auto target = static_cast<uint32_t>(std::ceil(histogram->total * fraction));
+    uint32_t seen = 0;
+    for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->counts[bucket];
+        if (seen >= target && seen > 0)
+        {
+            return bucket == LATENCY_HISTOGRAM_BUCKETS - 1 ? histogram->maxMilliseconds : bucket;
+        }
+    }
+    return histogram->maxMilliseconds;
+}
+
+// One row per non-empty bucket, the bar scaled to the fullest bucket.
+inline void LatencyHistogram_Print(const LatencyHistogram* histogram)
+{
+    constexpr int barWidth = 40;
+
+    uint32_t fullest = 1;
+    for (const uint32_t count: histogram->counts)
+    {
+        fullest = std::max(fullest, count);
+    }
+
+    printf("input latency: %u events | p50 %u ms | p95 %u ms | p99 %u ms | max %u ms\n", histogram->total,
+           LatencyHistogram_GetPercentile(histogram, 0.5), LatencyHistogram_GetPercentile(histogram, 0.95),
+           LatencyHistogram_GetPercentile(histogram, 0.99), histogram->maxMilliseconds);
+    for (int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+    {
+        const uint32_t count = histogram->counts[bucket];
+        if (count == 0) continue;
+
+        const int bar = std::max(1, static_cast<int>(static_cast<uint64_t>(count) * barWidth / fullest));
+        printf("  %3d%s ms | %-*.*s %u\n", bucket, bucket == LATENCY_HISTOGRAM_BUCKETS - 1 ? "+" : " ", barWidth, bar,
+               "########################################", count);
+    }
+}
+
+inline void PendingInput_Add(PendingInput* pending, const Uint32 timestamp)
+{
+    if (pending->count < LATENCY_MAX_PENDING_EVENTS)
+    {
+        pending->timestamps[pending->count++] = timestamp;
+    }
+}
+
+// Call right after SDL_RenderPresent returned: every pending event has reached the screen.
+inline void PendingInput_Presented(PendingInput* pending, LatencyHistogram* histogram)
+{
+    const Uint32 now = SDL_GetTicks();
+    for (int i = 0; i < pending->count; i++)
+    {
+        LatencyHistogram_Add(histogram, now - pending->timestamps[i]);
+    }
+    pending->count = 0;
+}
+
+// Paces frames to a fixed rate with the sleep at the start of the frame, timed so
+// that input sampling, rendering and presenting fit exactly into what is left of
+// the frame. The work estimate rises at once with a slower frame and decays
+// slowly, so a single fast frame does not make the next one late.
+struct FramePacer
+{
+    double frameMilliseconds;
+    double predictedWorkMilliseconds;
+    double nextPresent; // performance counter time, in milliseconds, the next present should finish by
+    double workStart;
+};
+
+inline double FramePacer_Now()
+{
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+inline void FramePacer_Init(FramePacer* pacer, const int framesPerSecond)
+{
+    pacer->frameMilliseconds = 1000.0 / framesPerSecond;
+    pacer->predictedWorkMilliseconds = 0;
+    pacer->nextPresent = FramePacer_Now();
+    pacer->workStart = pacer->nextPresent;
+}
+
+// Sleeps until the latest moment the frame can start and still be presented in
+// time. Call right before sampling input.
+inline void FramePacer_Wait(FramePacer* pacer)
+{
+    // SDL_Delay may oversleep by about a millisecond, wake that much earlier
+    constexpr double wakeMargin = 1.0;
+
+    const double wake = pacer->nextPresent - pacer->predictedWorkMilliseconds - wakeMargin;
+    const double now = FramePacer_Now();
+    if (wake > now + 1)
+    {
+        SDL_Delay(static_cast<Uint32>(wake - now));
+    }
+    pacer->workStart = FramePacer_Now();
+}
+
+// Call after the frame was presented, or skipped.
+inline void FramePacer_FrameDone(FramePacer* pacer)
+{
+    const double now = FramePacer_Now();
+    const double work = now - pacer->workStart;
+    pacer->predictedWorkMilliseconds = work > pacer->predictedWorkMilliseconds ? work : pacer->predictedWorkMilliseconds * 0.95 + work * 0.05;
+
+    pacer->nextPresent += pacer->frameMilliseconds;
+    if (pacer->nextPresent < now)
+    {
+        // Fell behind, start counting from now rather than rushing to catch up
+        pacer->nextPresent = now + pacer->frameMilliseconds;
+    }
+}
+
+#endif
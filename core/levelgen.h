@@ -0,0 +1,298 @@
+#ifndef LEVEL_GEN_H
+#define LEVEL_GEN_H
+#include "include.h"
+#include "structures.h"
+
+#include <random>
+
+// Seeded synthetic levels for stress testing. The same kind, size and seed give
+// the same level everywhere: only the raw std::mt19937 output is used, never the
+// standard distributions, whose results differ between standard libraries.
+// Layers are flat like LevelGrid, so a level of 8192 x 8192 cells takes 28 bytes
+// per cell instead of the overhead of the dense nested maps.
+
+enum LevelGenKind
+{
+    LEVEL_GEN_OPEN_FIELD,   // border walls and scattered pillars, rays run far
+    LEVEL_GEN_MAZE,         // one-cell corridors everywhere, rays stop early
+    LEVEL_GEN_CORRIDORS,    // long parallel corridors with rare doorways
+    LEVEL_GEN_SPRITE_ROOMS, // rooms with doorways, meant to be filled with things
+    LEVEL_GEN_KIND_COUNT
+};
+
+inline const char* LevelGenKind_GetName(const LevelGenKind kind)
+{
+    switch (kind)
+    {
+        case LEVEL_GEN_OPEN_FIELD: return "open";
+        case LEVEL_GEN_MAZE: return "maze";
+        case LEVEL_GEN_CORRIDORS: return "corridors";
+        case LEVEL_GEN_SPRITE_ROOMS: return "rooms";
+        default: return "?";
+    }
+}
+
+// Texture indices the generator assigns, matching the level's texture array.
+struct LevelGenTextures
+{
+    int firstWall, wallCount; // wall cells get firstWall + 1 .. firstWall + wallCount
+    int floor;
+    int ceiling;              // 0 leaves the sky visible
+    int firstSprite, spriteCount;
+};
+
+struct GeneratedLevel
+{
+    int width, height;
+    std::vector<int32_t> walls, floors, ceilings;
+    std::vector<double> lights, ceilingLights;
+    std::vector<Thing> things;
+    LevelGrid grid;
+    Vector spawn;
+};
+
+inline uint32_t LevelGen_Random(std::mt19937& rng, const uint32_t n)
+{
+    return static_cast<uint32_t>(rng() % n);
+}
+
+inline double LevelGen_RandomUnit(std::mt19937& rng)
+{
+    return rng() / 4294967296.0;
+}
+
+inline void LevelGen_SetWall(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng, const int x, const int y)
+{
+    level->walls[static_cast<size_t>(x) * level->height + y] = textures->firstWall + 1 + static_cast<int>(LevelGen_Random(rng, textures->wallCount));
+}
+
+inline bool LevelGen_IsOpen(const GeneratedLevel* level, const int x, const int y)
+{
+    return x >= 0 && x < level->width && y >= 0 && y < level->height && level->walls[static_cast<size_t>(x) * level->height + y] == 0;
+}
+
+inline void LevelGen_Border(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng)
+{
+    for (int x = 0; x < level->width; x++)
+    {
+        LevelGen_SetWall(level, textures, rng, x, 0);
+        LevelGen_SetWall(level, textures, rng, x, level->height - 1);
+    }
+    for (int y = 0; y < level->height; y++)
+    {
+        LevelGen_SetWall(level, textures, rng, 0, y);
+        LevelGen_SetWall(level, textures, rng, level->width - 1, y);
+    }
+}
+
+inline void LevelGen_OpenField(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng)
+{
+    LevelGen_Border(level, textures, rng);
+    for (int x = 2; x < level->width - 2; x++)
+    {
+        for (int y = 2; y < level->height - 2; y++)
+        {
+            if (LevelGen_Random(rng, 100) == 0)
+            {
+                LevelGen_SetWall(level, textures, rng, x, y);
+            }
+        }
+    }
+}
+
+// Depth-first backtracker over the odd cells, walls everywhere else.
+inline void LevelGen_Maze(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng)
+{
+    for (int x = 0; x < level->width; x++)
+    {
+        for (int y = 0; y < level->height; y++)
+        {
+            LevelGen_SetWall(level, textures, rng, x, y);
+        }
+    }
+
+    const int roomsX = (level->width - 1) / 2;
+    const int roomsY = (level->height - 1) / 2;
+    std::vector<uint8_t> visited(static_cast<size_t>(roomsX) * roomsY, 0);
+    std::vector<IVector> stack = {{0, 0}};
+    visited[0] = 1;
+    level->walls[static_cast<size_t>(1) * level->height + 1] = 0;
+
+    constexpr IVector directions[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    while (!stack.empty())
+    {
+        const IVector room = stack.back();
+
+        int candidates[4];
+        int candidateCount = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            const IVector next = {room.x + directions[d].x, room.y + directions[d].y};
+            if (next.x >= 0 && next.x < roomsX && next.y >= 0 && next.y < roomsY && !visited[static_cast<size_t>(next.x) * roomsY + next.y])
+            {
+                candidates[candidateCount++] = d;
+            }
+        }
+
+        if (candidateCount == 0)
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        const IVector direction = directions[candidates[LevelGen_Random(rng, candidateCount)]];
+        const IVector next = {room.x + direction.x, room.y + direction.y};
+        visited[static_cast<size_t>(next.x) * roomsY + next.y] = 1;
+        level->walls[static_cast<size_t>(2 * room.x + 1 + direction.x) * level->height + 2 * room.y + 1 + direction.y] = 0;
+        level->walls[static_cast<size_t>(2 * next.x + 1) * level->height + 2 * next.y + 1] = 0;
+        stack.push_back(next);
+    }
+}
+
+// Corridors three cells wide running along y, each wall line broken by a doorway every 64 cells.
+inline void LevelGen_Corridors(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng)
+{
+    LevelGen_Border(level, textures, rng);
+    for (int x = 4; x < level->width - 1; x += 4)
+    {
+        const int doorOffset = static_cast<int>(LevelGen_Random(rng, 64));
+        for (int y = 1; y < level->height - 1; y++)
+        {
+            if ((y + doorOffset) % 64 != 0)
+            {
+                LevelGen_SetWall(level, textures, rng, x, y);
+            }
+        }
+    }
+}
+
+// Square rooms of 16 x 16 cells, every wall between two rooms has a doorway in the middle.
+inline void LevelGen_SpriteRooms(GeneratedLevel* level, const LevelGenTextures* textures, std::mt19937& rng)
+{
+    constexpr int roomSize = 16;
+
+    LevelGen_Border(level, textures, rng);
+    for (int x = 1; x < level->width - 1; x++)
+    {
+        for (int y = 1; y < level->height - 1; y++)
+        {
+            const bool wallX = x % roomSize == 0 && y % roomSize != roomSize / 2;
+            const bool wallY = y % roomSize == 0 && x % roomSize != roomSize / 2;
+            if (wallX || wallY)
+            {
+                LevelGen_SetWall(level, textures, rng, x, y);
+            }
+        }
+    }
+}
+
+// First open cell on square rings of growing radius around center.
+inline IVector LevelGen_FindOpenCell(const GeneratedLevel* level, const IVector center)
+{
+    for (int radius = 0; radius < std::max(level->width, level->height); radius++)
+    {
+        for (int x = center.x - radius; x <= center.x + radius; x++)
+        {
+            for (int y = center.y - radius; y <= center.y + radius; y++)
+            {
+                const bool onRing = std::abs(x - center.x) == radius || std::abs(y - center.y) == radius;
+                if (onRing && LevelGen_IsOpen(level, x, y))
+                {
+                    return {x, y};
+                }
+            }
+        }
+    }
+    return {1, 1};
+}
+
+// Scatters thingCount things over the open cells, replacing any previous ones.
+inline void LevelGen_PlaceThings(GeneratedLevel* level, const LevelGenTextures* textures, const int thingCount, const uint32_t seed)
+{
+    std::mt19937 rng(seed ^ 0x9E3779B9u);
+
+    level->things.resize(thingCount);
+    for (Thing& thing: level->things)
+    {
+        IVector cell;
+        do
+        {
+            cell = {static_cast<int>(LevelGen_Random(rng, level->width)), static_cast<int>(LevelGen_Random(rng, level->height))};
+        } while (!LevelGen_IsOpen(level, cell.x, cell.y));
+
+        thing.position = {cell.x + 0.2 + 0.6 * LevelGen_RandomUnit(rng), cell.y + 0.2 + 0.6 * LevelGen_RandomUnit(rng)};
+        thing.textureIndex = textures->firstSprite + static_cast<int>(LevelGen_Random(rng, textures->spriteCount));
+    }
+}
+
+// Generates a size x size level of the given kind without things. The camera
+// spawns in the open cell closest to the center.
+inline void LevelGen_Generate(GeneratedLevel* level, const LevelGenKind kind, const int size, const LevelGenTextures* textures, const uint32_t seed)
+{
+    std::mt19937 rng(seed);
+
+    const size_t cells = static_cast<size_t>(size) * size;
+    level->width = size;
+    level->height = size;
+    level->walls.assign(cells, 0);
+    level->floors.assign(cells, textures->floor);
+    level->ceilings.assign(cells, textures->ceiling);
+    level->lights.assign(cells, 1.0);
+    level->ceilingLights.assign(cells, 1.0);
+    level->things.clear();
+
+    switch (kind)
+    {
+        case LEVEL_GEN_OPEN_FIELD: LevelGen_OpenField(level, textures, rng); break;
+        case LEVEL_GEN_MAZE: LevelGen_Maze(level, textures, rng); break;
+        case LEVEL_GEN_CORRIDORS: LevelGen_Corridors(level, textures, rng); break;
+        default: LevelGen_SpriteRooms(level, textures, rng); break;
+    }
+
+    const IVector spawn = LevelGen_FindOpenCell(level, {size / 2, size / 2});
+    level->spawn = {spawn.x + 0.5, spawn.y + 0.5};
+
+    level->grid = {size, size, level->walls.data(), level->floors.data(), level->ceilings.data(), level->lights.data(), level->ceilingLights.data()};
+}
+
+// Points a level at the generated layers and things. The generated level must outlive it.
+inline void GeneratedLevel_Bind(const GeneratedLevel* generated, Level* level)
+{
+    level->grid = &generated->grid;
+    level->world = nullptr;
+    level->mapWidth = generated->width;
+    level->mapHeight = generated->height;
+    level->things = const_cast<Thing*>(generated->things.data());
+    level->thingCount = static_cast<int>(generated->things.size());
+}
+
+// Fixed camera path of frameCount frames through the open cells: walks forward
+// from the spawn, turns a quarter when the next step would enter a wall and
+// keeps turning slowly so every direction is covered.
+inline void LevelGen_MakeCameraPath(const GeneratedLevel* level, const int frameCount, std::vector<Camera>* path)
+{
+    constexpr double stepLength = 0.1;
+    constexpr double turnPerFrame = 0.02;
+
+    path->resize(frameCount);
+    Vector position = level->spawn;
+    double angle = 0;
+    for (int i = 0; i < frameCount; i++)
+    {
+        const Vector direction = {std::cos(angle), std::sin(angle)};
+        (*path)[i] = {position, direction, {direction.y * 0.66, -direction.x * 0.66}};
+
+        const Vector next = {position.x + direction.x * stepLength, position.y + direction.y * stepLength};
+        if (LevelGen_IsOpen(level, static_cast<int>(next.x), static_cast<int>(next.y)))
+        {
+            position = next;
+            angle += turnPerFrame;
+        }
+        else
+        {
+            angle += std::acos(-1.0) / 2;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+#include "include.h"
+#include "structures.h"
+
+#if defined(__AVX2__)
+#define PALETTE_AVX2
+#include <immintrin.h>
+#endif
+
+#define PALETTE_SIZE 256
+#define PALETTE_TRANSPARENT 0
+#define PALETTE_LIGHT_LEVELS 16
+#define PALETTE_LIGHT_SCALE 8
+#define PALETTE_SHADE_LEVELS 32
+
+// Shared 256 color palette for the indexed render path. Index 0 is reserved for
+// pure black, the sprite color key, so it can double as the transparent index.
+// colormaps[light][shade] maps every palette index to the index closest to that
+// color after Darken(shade) and Lighten(light), turning shading into one lookup.
+struct Palette
+{
+    Pixel colors[PALETTE_SIZE];
+    uint8_t nearest[1 << 15]; // RGB555 -> closest index in [1, PALETTE_SIZE)
+    uint8_t colormaps[PALETTE_LIGHT_LEVELS][PALETTE_SHADE_LEVELS][PALETTE_SIZE];
+};
+
+inline int Palette_Key(const Pixel p)
+{
+    return (p.r >> 3) << 10 | (p.g >> 3) << 5 | p.b >> 3;
+}
+
+inline bool Palette_IsBlack(const Pixel p)
+{
+    return p.r == 0 && p.g == 0 && p.b == 0;
+}
+
+inline uint8_t Palette_Map(const Palette* palette, const Pixel p)
+{
+    return Palette_IsBlack(p) ? PALETTE_TRANSPARENT : palette->nearest[Palette_Key(p)];
+}
+
+struct PaletteBin
+{
+    int key;
+    int count;
+    double r, g, b;
+};
+
+// Median cut over the RGB555 histogram of every texel in the given textures.
+inline void Palette_Build(Palette* palette, const Texture* textures, const int textureCount)
+{
+    std::vector<PaletteBin> bins(1 << 15);
+    for (int key = 0; key < 1 << 15; key++)
+    {
+        bins[key] = {key, 0, 0, 0, 0};
+    }
+
+    for (int t = 0; t < textureCount; t++)
+    {
+        const Texture& tex = textures[t];
+        for (int i = 0; i < tex.width * tex.height; i++)
+        {
+            const Pixel p = tex.pixels[i];
+            if (Palette_IsBlack(p)) continue;
+
+            PaletteBin& bin = bins[Palette_Key(p)];
+            bin.count++;
+            bin.r += p.r;
+            bin.g += p.g;
+            bin.b += p.b;
+        }
+    }
+
+    std::erase_if(bins, [](const PaletteBin& bin) { return bin.count == 0; });
+
+    // Boxes are [begin, end) ranges of bins, split at the weighted median of their widest channel
+    std::vector<std::pair<int, int>> boxes;
+    if (!bins.empty())
+    {
+        boxes.emplace_back(0, static_cast<int>(bins.size()));
+    }
+
+    const auto channel = [](const PaletteBin& bin, const int c) { return bin.key >> (10 - 5 * c) & 31; };
+
+    while (static_cast<int>(boxes.size()) < PALETTE_SIZE - 1)
+    {
+        int bestBox = -1, bestChannel = 0, bestRange = 0;
+        for (int i = 0; i < static_cast<int>(boxes.size()); i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int lo = 31, hi = 0;
+                for (int b = boxes[i].first; b < boxes[i].second; b++)
+                {
+                    lo = std::min(lo, channel(bins[b], c));
+                    hi = std::max(hi, channel(bins[b], c));
+                }
+                if (hi - lo > bestRange)
+                {
+                    bestBox = i;
+                    bestChannel = c;
+                    bestRange = hi - lo;
+                }
+            }
+        }
+
+        if (bestBox == -1) break;
+
+        auto [begin, end] = boxes[bestBox];
+        std::sort(bins.begin() + begin, bins.begin() + end, [&](const PaletteBin& a, const PaletteBin& b)
+        {
+            return channel(a, bestChannel) < channel(b, bestChannel);
+        });
+
+        int64_t total = 0;
+        for (int b = begin; b < end; b++) total += bins[b].count;
+
+        int split = begin + 1;
+        int64_t running = bins[begin].count;
+        while (split < end - 1 && running * 2 < total)
+        {
+            running += bins[split++].count;
+        }
+
+        boxes[bestBox] = {begin, split};
+        boxes.emplace_back(split, end);
+    }
+
+    palette->colors[PALETTE_TRANSPARENT].rgba = 0;
+    palette->colors[PALETTE_TRANSPARENT].a = 0xFF;
+
+    int colorCount = 1;
+    for (const auto& [begin, end]: boxes)
+    {
+        double r = 0, g = 0, b = 0, count = 0;
+        for (int i = begin; i < end; i++)
+        {
+            r += bins[i].r;
+            g += bins[i].g;
+            b += bins[i].b;
+            count += bins[i].count;
+        }
+
+        Pixel& color = palette->colors[colorCount++];
+        color.r = static_cast<uint8_t>(r / count + 0.5);
+        color.g = static_cast<uint8_t>(g / count + 0.5);
+        color.b = static_cast<uint8_t>(b / count + 0.5);
+        color.a = 0xFF;
+    }
+
+    for (int i = colorCount; i < PALETTE_SIZE; i++)
+    {
+        palette->colors[i] = palette->colors[std::max(colorCount - 1, 0)];
+    }
+
+    for (int key = 0; key < 1 << 15; key++)
+    {
+        const int r = (key >> 10 & 31) << 3 | 4;
+        const int g = (key >> 5 & 31) << 3 | 4;
+        const int b = (key & 31) << 3 | 4;
+
+        int best = 1, bestDistance = std::numeric_limits<int>::max();
+        for (int i = 1; i < colorCount; i++)
+        {
+            const Pixel c = palette->colors[i];
+            const int distance = (c.r - r) * (c.r - r) + (c.g - g) * (c.g - g) + (c.b - b) * (c.b - b);
+            if (distance < bestDistance)
+            {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        palette->nearest[key] = static_cast<uint8_t>(best);
+    }
+
+    for (int light = 0; light < PALETTE_LIGHT_LEVELS; light++)
+    {
+        for (int shade = 0; shade < PALETTE_SHADE_LEVELS; shade++)
+        {
+            uint8_t* colormap = palette->colormaps[light][shade];
+            colormap[PALETTE_TRANSPARENT] = PALETTE_TRANSPARENT;
+
+            for (int i = 1; i < PALETTE_SIZE; i++)
+            {
+                Pixel p = palette->colors[i];
+                const double shadingPerc = static_cast<double>(shade) / PALETTE_SHADE_LEVELS;
+                const double lightness = static_cast<double>(light) / PALETTE_LIGHT_SCALE;
+                p.r = p.r * (1.0 - shadingPerc);
+                p.g = p.g * (1.0 - shadingPerc);
+                p.b = p.b * (1.0 - shadingPerc);
+                p.r = std::min(p.r * lightness, 255.0);
+                p.g = std::min(p.g * lightness, 255.0);
+                p.b = std::min(p.b * lightness, 255.0);
+                colormap[i] = palette->nearest[Palette_Key(p)];
+            }
+        }
+    }
+}
+
+// Fills texture->indexedPixels with palette indices of its texels.
+inline void Palette_QuantizeTexture(const Palette* palette, Texture* texture)
+{
+    delete[] texture->indexedPixels;
+    texture->indexedPixels = new uint8_t[texture->width * texture->height];
+
+    for (int i = 0; i < texture->width * texture->height; i++)
+    {
+        texture->indexedPixels[i] = Palette_Map(palette, texture->pixels[i]);
+    }
+}
+
+inline const uint8_t* Palette_GetColormap(const Palette* palette, const double lightValue, const double shadingPerc)
+{
+    const int light = std::clamp(static_cast<int>(lightValue * PALETTE_LIGHT_SCALE + 0.5), 0, PALETTE_LIGHT_LEVELS - 1);
+    const int shade = std::clamp(static_cast<int>(shadingPerc * PALETTE_SHADE_LEVELS + 0.5), 0, PALETTE_SHADE_LEVELS - 1);
+    return palette->colormaps[light][shade];
+}
+
+// Expands an indexed frame into 32-bit pixels. Unrolled by four so the loads,
+// the table lookups and the stores of neighbouring pixels overlap. With AVX2,
+// eight indices at a time are widened and looked up with one gather.
+inline void Palette_Expand(const Palette* palette, const uint8_t* indices, uint32_t* out, const int count)
+{
+    uint32_t table[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; i++)
+    {
+        table[i] = palette->colors[i].rgba;
+    }
+
+    int i = 0;
+#ifdef PALETTE_AVX2
+    const auto gatherTable = reinterpret_cast<const int*>(table);
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i offsets = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(gatherTable, offsets, 4));
+    }
+#endif
+    for (; i + 4 <= count; i += 4)
+    {
+        out[i + 0] = table[indices[i + 0]];
+        out[i + 1] = table[indices[i + 1]];
+        out[i + 2] = table[indices[i + 2]];
+        out[i + 3] = table[indices[i + 3]];
+    }
+    for (; i < count; i++)
+    {
+        out[i] = table[indices[i]];
+    }
+}
+
+#endif
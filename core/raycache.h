@@ -0,0 +1,171 @@
+#ifndef RAY_CACHE_H
+#define RAY_CACHE_H
+#include "include.h"
+#include "structures.h"
+#include "raycast.h"
+
+#include <numbers>
+
+// Wall hits of camera rays keyed by quantized ray angle, valid while the camera
+// stays at one position. Turning in place re-aims every column, but most new
+// rays fall into a bucket a ray of the frame before filled, and so almost always
+// end on the same face of the same wall cell. A cached entry is only a guess of
+// that face. It is taken when both neighbouring buckets hold the same face too,
+// so no silhouette edge can lie between the old rays and the new one, and when
+// the new ray, intersected with the face exactly, lands on it with an open cell
+// in front. Distance, side and the point along the wall then come from the new
+// ray, so reused columns draw like cast ones. Rays the guess does not fit fall
+// back to the DDA and refill their bucket.
+struct AngularRayEntry
+{
+    IVector cell;
+    int side;
+    uint32_t generation; // the entry is valid while it matches the cache's generation
+};
+
+struct AngularRayCache
+{
+    std::vector<AngularRayEntry> entries;
+    std::vector<double> columnTurns; // angle of each column's ray from the view direction, in buckets
+    uint32_t generation = 0;
+    double viewTurn = 0;             // angle of the view direction of the current cast, in buckets
+
+    // What the entries were cast from
+    const Level* level = nullptr;
+    uint64_t levelRevision = 0;
+    Vector position = {0, 0};
+    int width = 0;
+    double planeRatio = 0;
+
+    // Counted over all casts, the owner clears them
+    uint64_t reusedRays = 0;
+    uint64_t castRays = 0;
+};
+
+inline void AngularRayCache_Invalidate(AngularRayCache* cache)
+{
+    cache->generation++;
+}
+
+// Starts a cast of width columns. Starts over when the camera moved, the level or
+// its paged cells changed or the view has a different width or field of view.
+// planeRatio is the camera plane's length over the direction's, negative when
+// the plane points clockwise of the direction. Buckets are as wide as the angle
+// between two central columns, so every new ray has a fair chance of finding
+// one filled.
+inline void AngularRayCache_Begin(AngularRayCache* cache, const Level* level, const Vector position, const Vector direction,
+                                  const double planeRatio, const int width)
+{
+    // Ratios of a rotated camera differ in the last bits, which does not move a column by a bucket
+    if (width != cache->width || std::abs(planeRatio - cache->planeRatio) > 1e-9 * std::abs(planeRatio))
+    {
+        const double bucketsPerRadian = width / (2 * std::abs(planeRatio));
+        const int bucketCount = static_cast<int>(std::ceil(2 * std::numbers::pi * bucketsPerRadian));
+        cache->entries.assign(bucketCount, {});
+        cache->generation = 0;
+        cache->width = width;
+        cache->planeRatio = planeRatio;
+
+        cache->columnTurns.resize(width);
+        for (int x = 0; x < width; x++)
+        {
+            const double cameraX = 2 * x / static_cast<double>(width) - 1;
+            cache->columnTurns[x] = std::atan(cameraX * planeRatio) * bucketsPerRadian;
+        }
+    }
+
+    if (cache->level != level || cache->levelRevision != Level_GetRevision(level) ||
+        cache->position.x != position.x || cache->position.y != position.y)
+    {
+        AngularRayCache_Invalidate(cache);
+        cache->level = level;
+        cache->levelRevision = Level_GetRevision(level);
+        cache->position = position;
+    }
+
+    // Generation 0 marks never written entries
+    if (cache->generation == 0)
+    {
+        cache->generation = 1;
+    }
+
+    const double bucketCount = static_cast<double>(cache->entries.size());
+    cache->viewTurn = (std::atan2(direction.y, direction.x) + std::numbers::pi) / (2 * std::numbers::pi) * bucketCount;
+}
+
+// Bucket of column x of the current cast.
+inline int AngularRayCache_GetBucket(const AngularRayCache* cache, const int x)
+{
+    const int bucketCount = static_cast<int>(cache->entries.size());
+    const int bucket = static_cast<int>(std::floor(cache->viewTurn + cache->columnTurns[x])) % bucketCount;
+    return bucket < 0 ? bucket + bucketCount : bucket;
+}
+
+// The face the bucket's ray hit last, when the buckets around it agree, or null.
+inline const AngularRayEntry* AngularRayCache_Find(const AngularRayCache* cache, const int bucket)
+{
+    const int bucketCount = static_cast<int>(cache->entries.size());
+    const AngularRayEntry* entry = &cache->entries[bucket];
+    if (entry->generation != cache->generation)
+    {
+        return nullptr;
+    }
+
+    for (const int neighbour: {bucket == 0 ? bucketCount - 1 : bucket - 1, bucket == bucketCount - 1 ? 0 : bucket + 1})
+    {
+        const AngularRayEntry* other = &cache->entries[neighbour];
+        if (other->generation != cache->generation || other->side != entry->side ||
+            other->cell.x != entry->cell.x || other->cell.y != entry->cell.y)
+        {
+            return nullptr;
+        }
+    }
+    return entry;
+}
+
+inline void AngularRayCache_Store(AngularRayCache* cache, const int bucket, const RayHit* hit)
+{
+    cache->entries[bucket] = {hit->cell, hit->side, cache->generation};
+}
+
+// Intersects the ray with the face of the cached cell it would enter through.
+inline bool AngularRayCache_Resolve(const Level* level, const Vector origin, const Vector rayDirection, const AngularRayEntry* entry, RayHit* hit)
+{
+    const IVector cell = entry->cell;
+    double distance;
+    IVector front = cell;
+
+    if (entry->side == 0)
+    {
+        if (rayDirection.x == 0) return false;
+
+        const int step = rayDirection.x > 0 ? 1 : -1;
+        distance = ((step > 0 ? cell.x : cell.x + 1) - origin.x) / rayDirection.x;
+        const double y = origin.y + distance * rayDirection.y;
+        if (y < cell.y || y >= cell.y + 1) return false;
+        front.x -= step;
+    }
+    else
+    {
+        if (rayDirection.y == 0) return false;
+
+        const int step = rayDirection.y > 0 ? 1 : -1;
+        distance = ((step > 0 ? cell.y : cell.y + 1) - origin.y) / rayDirection.y;
+        const double x = origin.x + distance * rayDirection.x;
+        if (x < cell.x || x >= cell.x + 1) return false;
+        front.y -= step;
+    }
+
+    if (distance <= 0 || !Ray_IsInsideMap(level, front) || Level_GetWall(level, front.x, front.y) > 0)
+    {
+        return false;
+    }
+
+    hit->cell = cell;
+    hit->distance = distance;
+    hit->side = entry->side;
+    hit->hit = true;
+    return true;
+}
+
+#endif
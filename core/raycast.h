@@ -0,0 +1,141 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+#include "include.h"
+#include "structures.h"
+#include "jobpool.h"
+#include "chunkedworld.h"
+
+#define RAY_BATCH_CHUNK 1024
+
+// Distances are measured in multiples of the direction vector, so a camera ray
+// (direction + plane * cameraX) yields the perpendicular wall distance and a
+// ray towards a target yields 1.0 at the target.
+struct RayQuery
+{
+    Vector origin;
+    Vector direction;
+    double maxDistance;
+};
+
+struct RayHit
+{
+    IVector cell;    // wall cell that stopped the ray, or the last cell visited
+    double distance; // distance at which the ray entered `cell`
+    int side;        // 0 when a x-side was crossed last, 1 for a y-side
+    bool hit;        // a wall was found within maxDistance
+};
+
+inline RayQuery RayQuery_FromDirection(const Vector origin, const Vector direction, const double maxDistance)
+{
+    return {origin, direction, maxDistance};
+}
+
+// Line of sight from origin to target: visible when the hit comes back false.
+inline RayQuery RayQuery_FromTarget(const Vector origin, const Vector target)
+{
+    return {origin, {target.x - origin.x, target.y - origin.y}, 1.0};
+}
+
+inline bool Ray_IsInsideMap(const Level* level, const IVector cell)
+{
+    return cell.x >= 0 && cell.x < level->mapWidth && cell.y >= 0 && cell.y < level->mapHeight;
+}
+
+// Walks the wall grid cell by cell until a wall is entered, the ray passes
+// maxDistance or it leaves the map. Leaving the map counts as a miss.
+inline void Ray_Cast(const Level* level, const RayQuery* query, RayHit* result)
+{
+    const Vector& position = query->origin;
+    const Vector& rayDirection = query->direction;
+
+    IVector mapPosition = {static_cast<int>(std::floor(position.x)), static_cast<int>(std::floor(position.y))};
+    Vector sideDist;
+    Vector deltaDist = {rayDirection.x == 0 ? 1e30 : std::abs(1 / rayDirection.x), rayDirection.y == 0 ? 1e30 : std::abs(1 / rayDirection.y)};
+    IVector step;
+    int side = 0;
+
+    if (rayDirection.x < 0)
+    {
+        step.x = -1;
+        sideDist.x = (position.x - mapPosition.x) * deltaDist.x;
+    }
+    else
+    {
+        step.x = 1;
+        sideDist.x = (mapPosition.x + 1.0 - position.x) * deltaDist.x;
+    }
+
+    if (rayDirection.y < 0)
+    {
+        step.y = -1;
+        sideDist.y = (position.y - mapPosition.y) * deltaDist.y;
+    }
+    else
+    {
+        step.y = 1;
+        sideDist.y = (mapPosition.y + 1.0 - position.y) * deltaDist.y;
+    }
+
+    result->hit = false;
+
+    while (true)
+    {
+        double distance;
+        if (sideDist.x < sideDist.y)
+        {
+            distance = sideDist.x;
+            sideDist.x += deltaDist.x;
+            mapPosition.x += step.x;
+            side = 0;
+        }
+        else
+        {
+            distance = sideDist.y;
+            sideDist.y += deltaDist.y;
+            mapPosition.y += step.y;
+            side = 1;
+        }
+
+        result->cell = mapPosition;
+        result->distance = distance;
+        result->side = side;
+
+        if (distance > query->maxDistance || !Ray_IsInsideMap(level, mapPosition))
+        {
+            return;
+        }
+
+        if (Level_GetWall(level, mapPosition.x, mapPosition.y) > 0)
+        {
+            result->hit = true;
+            return;
+        }
+    }
+}
+
+// Answers count queries, with large batches split across the pool's threads in
+// chunks of RAY_BATCH_CHUNK. Pass a null pool to run on the calling thread.
+inline void Ray_CastBatch(const Level* level, const RayQuery* queries, RayHit* results, const int count, JobPool* pool)
+{
+    const auto castRange = [&](const int first, const int last)
+    {
+        for (int i = first; i < last; i++)
+        {
+            Ray_Cast(level, &queries[i], &results[i]);
+        }
+    };
+
+    if (pool == nullptr || count <= RAY_BATCH_CHUNK)
+    {
+        castRange(0, count);
+        return;
+    }
+
+    const int chunkCount = (count + RAY_BATCH_CHUNK - 1) / RAY_BATCH_CHUNK;
+    pool->ParallelFor(chunkCount, [&](const int chunk, int)
+    {
+        castRange(chunk * RAY_BATCH_CHUNK, std::min((chunk + 1) * RAY_BATCH_CHUNK, count));
+    });
+}
+
+#endif
@@ -0,0 +1,889 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+#include "include.h"
+#include "structures.h"
+#include "depthhierarchy.h"
+#include "jobpool.h"
+#include "raycast.h"
+#include "arena.h"
+#include "palette.h"
+#include "renderstats.h"
+#include "sampler.h"
+#include "framebuffer.h"
+#include "raycache.h"
+#include "deferred.h"
+
+#define MAX_VIEW_DIST 20
+
+struct Camera
+{
+    Vector position;
+    Vector direction;
+    Vector plane;
+};
+
+enum ViewFormat
+{
+    VIEW_FORMAT_RGBA,      // uint32_t per pixel, same layout as Pixel
+    VIEW_FORMAT_GRAYSCALE, // uint8_t luminance per pixel
+    VIEW_FORMAT_DEPTH      // float per column, perpendicular distance to the first wall
+};
+
+// Output framebuffer of one camera, rows are tightly packed.
+struct View
+{
+    void* pixels;
+    int width, height;
+    ViewFormat format;
+};
+
+// Per-thread working memory of the renderer. Transient per-view buffers come
+// from the arena, which the owner resets once per frame (Renderer_DrawCameraView
+// resets it per view). Workload is counted into stats when it is set, wall
+// hits are reused from rayCache when it is set.
+struct RenderScratch
+{
+    FrameArena arena;
+    DepthHierarchy depthHierarchy;
+    RenderStats* stats = nullptr;
+    AngularRayCache* rayCache = nullptr;
+};
+
+inline int PosMod(const int i, const int n)
+{
+    return (i % n + n) % n;
+}
+
+//sort algorithm
+//sort the sprites based on distance, sprites is workspace for amount pairs
+inline void sortSprites(int* order, double* dist, int amount, std::pair<double, int>* sprites)
+{
+    for (int i = 0; i < amount; i++)
+    {
+        sprites[i].first = dist[i];
+        sprites[i].second = order[i];
+    }
+    std::ranges::sort(sprites, sprites + amount);
+    // restore in reverse order to go from farthest to nearest
+    for (int i = 0; i < amount; i++)
+    {
+        dist[i] = sprites[amount - i - 1].first;
+        order[i] = sprites[amount - i - 1].second;
+    }
+}
+
+inline void Darken(Pixel* p, const double shadingPerc)
+{
+    p->r = p->r * (1.0 - shadingPerc);
+    p->g = p->g * (1.0 - shadingPerc);
+    p->b = p->b * (1.0 - shadingPerc);
+}
+
+inline void Lighten(Pixel* p, const double lightness)
+{
+    p->r = std::min(p->r * lightness, 255.0);
+    p->g = std::min(p->g * lightness, 255.0);
+    p->b = std::min(p->b * lightness, 255.0);
+}
+
+// Shading policies the passes are instantiated with. A shader turns a texel
+// index of a texture into an output pixel, with Shade holding whatever it
+// precomputes for a constant distance shade and tile light.
+struct RgbaShader
+{
+    using Output = uint32_t;
+
+    struct Shade
+    {
+        double shadingPerc;
+        double lightValue;
+    };
+
+    Shade MakeShade(const double shadingPerc, const double lightValue) const
+    {
+        return {shadingPerc, lightValue};
+    }
+
+    Output Fetch(const Texture& tex, const int index) const
+    {
+        return tex.pixels[index].rgba;
+    }
+
+    bool IsTransparent(const Texture& tex, const int index) const
+    {
+        const Pixel p = tex.pixels[index];
+        return p.r == 0 && p.g == 0 && p.b == 0;
+    }
+
+    Output Apply(const Texture& tex, const int index, const Shade& shade) const
+    {
+        Pixel p = tex.pixels[index];
+        Darken(&p, shade.shadingPerc);
+        Lighten(&p, shade.lightValue);
+        return p.rgba;
+    }
+};
+
+// 8-bit path: texels are palette indices and shading is a colormap lookup.
+struct IndexedShader
+{
+    using Output = uint8_t;
+    using Shade = const uint8_t*;
+
+    const Palette* palette;
+
+    Shade MakeShade(const double shadingPerc, const double lightValue) const
+    {
+        return Palette_GetColormap(palette, lightValue, shadingPerc);
+    }
+
+    Output Fetch(const Texture& tex, const int index) const
+    {
+        return tex.indexedPixels[index];
+    }
+
+    bool IsTransparent(const Texture& tex, const int index) const
+    {
+        return tex.indexedPixels[index] == PALETTE_TRANSPARENT;
+    }
+
+    Output Apply(const Texture& tex, const int index, const Shade& shade) const
+    {
+        return shade[tex.indexedPixels[index]];
+    }
+};
+
+// Deferred path: texels keep their color and carry the light and fog attribute
+// in their fourth byte, Deferred_Shade applies it over the finished frame.
+struct DeferredShader
+{
+    using Output = uint32_t;
+    using Shade = uint8_t;
+
+    Shade MakeShade(const double shadingPerc, const double lightValue) const
+    {
+        return Deferred_PackAttribute(shadingPerc, lightValue);
+    }
+
+    Output Fetch(const Texture& tex, const int index) const
+    {
+        Pixel p = tex.pixels[index];
+        p.a = DEFERRED_UNSHADED;
+        return p.rgba;
+    }
+
+    bool IsTransparent(const Texture& tex, const int index) const
+    {
+        const Pixel p = tex.pixels[index];
+        return p.r == 0 && p.g == 0 && p.b == 0;
+    }
+
+    Output Apply(const Texture& tex, const int index, const Shade& shade) const
+    {
+        Pixel p = tex.pixels[index];
+        p.a = shade;
+        return p.rgba;
+    }
+};
+
+// The passes take an optional column mask: when given, only columns with a non-zero entry are drawn,
+// and optional stats to count their workload into. Passes drawn in columns can also be instantiated
+// for a column-major buffer through their Layout parameter.
+inline bool Renderer_IsColumnSkipped(const uint8_t* columnMask, const int x)
+{
+    return columnMask != nullptr && columnMask[x] == 0;
+}
+
+template<typename Layout = RowMajorLayout, typename Shader>
+void Renderer_DrawSky(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                      const uint8_t* columnMask = nullptr, RenderStats* stats = nullptr)
+{
+    const Texture& skyTexure = level->textures[level->skyTexture];
+    const Layout layout = {width, height};
+
+    Sampler_Dispatch(skyTexure, [&](const auto sampler)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (Renderer_IsColumnSkipped(columnMask, x)) continue;
+
+            const double cameraX = 2 * x / static_cast<double>(width) - 1;
+            const double playerAngle = std::atan2(camera->direction.y, camera->direction.x);
+            const double textureColumn = sampler.GetWidth() * ((std::atan2(1, cameraX) + playerAngle) / std::numbers::pi);
+            const int texX = sampler.WrapX(static_cast<int>(textureColumn));
+
+            int rowStep = sampler.GetHeight() / height;
+            for (int y = 0; y < height / 2; y++)
+            {
+                const int texY = y * rowStep;
+                buffer[layout.Index(x, y)] = shader.Fetch(skyTexure, sampler.Index(texX, texY));
+                RENDER_STATS_PIXEL(stats, RENDER_PASS_SKY, y * width + x);
+            }
+            RENDER_STATS_ADD(stats, texelFetches, height / 2);
+        }
+    });
+}
+
+// First pixel x at which origin + x * step has left the cell [cell, cell + 1), capped at width.
+inline int Renderer_GetCellExit(const double origin, const double step, const int cell, const int width)
+{
+    if (step > 0)
+    {
+        return static_cast<int>(std::min(std::ceil((cell + 1 - origin) / step), static_cast<double>(width)));
+    }
+    if (step < 0)
+    {
+        return static_cast<int>(std::min(std::floor((cell - origin) / step) + 1, static_cast<double>(width)));
+    }
+    return width;
+}
+
+// Floor and ceiling are cast row by row. Each row is split into spans of pixels
+// that see the same map cell, the span ends follow analytically from floorStep.
+// Textures, lights and shades are looked up once per span, the inner loops only
+// step the position within the cell, kept as a 32-bit fixed-point fraction that
+// wraps by itself, and let the texture's sampler scale it to the texture size.
+template<typename Shader>
+void Renderer_DrawFloorAndCeiling(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                                  const uint8_t* columnMask = nullptr, RenderStats* stats = nullptr)
+{
+    const Vector& position = camera->position;
+    const Vector& direction = camera->direction;
+    const Vector& plane = camera->plane;
+
+    constexpr double fractionScale = 4294967296.0;
+
+    for (int y = height / 2; y < height; y++)
+    {
+        Vector leftMostRay = {direction.x - plane.x, direction.y - plane.y};
+        Vector rightMostRay = {direction.x + plane.x, direction.y + plane.y};
+
+        double positionZ = 0.5 * height;
+        int p = y - height / 2;
+        double rowDistance = positionZ / p;
+
+        Vector floorStep = {
+            rowDistance * (rightMostRay.x - leftMostRay.x) / width,
+            rowDistance * (rightMostRay.y - leftMostRay.y) / width
+        };
+        Vector floorOrigin = {
+            position.x + rowDistance * leftMostRay.x,
+            position.y + rowDistance * leftMostRay.y
+        };
+
+        double shadingPerc = 1 - p / positionZ - 0.25;
+        shadingPerc = std::min(shadingPerc, 0.75);
+        shadingPerc = std::max(shadingPerc, 0.0);
+
+        const auto stepU = static_cast<uint32_t>(static_cast<int64_t>(std::llround(floorStep.x * fractionScale)));
+        const auto stepV = static_cast<uint32_t>(static_cast<int64_t>(std::llround(floorStep.y * fractionScale)));
+
+        auto floorRow = buffer + y * width;
+        auto ceilingRow = buffer + (height - y - 1) * width;
+
+        int x = 0;
+        while (x < width)
+        {
+            const Vector floor = {floorOrigin.x + x * floorStep.x, floorOrigin.y + x * floorStep.y};
+            const IVector worldCell = {static_cast<int>(std::floor(floor.x)), static_cast<int>(std::floor(floor.y))};
+            const int spanEnd = std::max(x + 1, std::min(
+                Renderer_GetCellExit(floorOrigin.x, floorStep.x, worldCell.x, width),
+                Renderer_GetCellExit(floorOrigin.y, floorStep.y, worldCell.y, width)));
+
+            const IVector cell = {PosMod(worldCell.x, level->mapWidth), PosMod(worldCell.y, level->mapHeight)};
+
+            const Texture* floorTexture = &level->textures[Level_GetFloor(level, cell.x, cell.y)];
+            const auto floorShade = shader.MakeShade(shadingPerc, Level_GetLight(level, cell.x, cell.y));
+
+            const int ceilingTexIndex = Level_GetCeiling(level, cell.x, cell.y);
+            const Texture* ceilingTexture = ceilingTexIndex > 0 ? &level->textures[ceilingTexIndex] : nullptr;
+            const auto ceilShade = shader.MakeShade(shadingPerc, Level_GetCeilingLight(level, cell.x, cell.y));
+
+            const auto spanU = static_cast<uint32_t>(static_cast<int64_t>((floor.x - worldCell.x) * fractionScale));
+            const auto spanV = static_cast<uint32_t>(static_cast<int64_t>((floor.y - worldCell.y) * fractionScale));
+            const int spanStart = x;
+
+            Sampler_Dispatch(*floorTexture, [&](const auto sampler)
+            {
+                uint32_t u = spanU, v = spanV;
+                for (int sx = spanStart; sx < spanEnd; sx++, u += stepU, v += stepV)
+                {
+                    if (Renderer_IsColumnSkipped(columnMask, sx)) continue;
+
+                    floorRow[sx] = shader.Apply(*floorTexture, sampler.Index(sampler.ScaleX(u), sampler.ScaleY(v)), floorShade);
+                    RENDER_STATS_PIXEL(stats, RENDER_PASS_FLOOR, y * width + sx);
+                    RENDER_STATS_ADD(stats, texelFetches, 1);
+                }
+            });
+
+            if (ceilingTexture != nullptr)
+            {
+                Sampler_Dispatch(*ceilingTexture, [&](const auto sampler)
+                {
+                    uint32_t u = spanU, v = spanV;
+                    for (int sx = spanStart; sx < spanEnd; sx++, u += stepU, v += stepV)
+                    {
+                        if (Renderer_IsColumnSkipped(columnMask, sx)) continue;
+
+                        ceilingRow[sx] = shader.Apply(*ceilingTexture, sampler.Index(sampler.ScaleX(u), sampler.ScaleY(v)), ceilShade);
+                        RENDER_STATS_PIXEL(stats, RENDER_PASS_CEILING, (height - y - 1) * width + sx);
+                        RENDER_STATS_ADD(stats, texelFetches, 1);
+                    }
+                });
+            }
+
+            x = spanEnd;
+        }
+    }
+}
+
+inline Vector Renderer_GetRayDirection(const Camera* camera, const int x, const int width)
+{
+    const double cameraX = 2 * x / static_cast<double>(width) - 1;
+    return {camera->direction.x + camera->plane.x * cameraX, camera->direction.y + camera->plane.y * cameraX};
+}
+
+// Casts one ray per column and stores the hit and the perpendicular wall distance.
+// This is all a depth view needs, Renderer_DrawWalls turns the hits into pixels.
+inline void Renderer_CastWalls(const Level* level, const Camera* camera, const int width, RayHit* hits, double* zBuffer,
+                               const uint8_t* columnMask = nullptr)
+{
+    for (int x = 0; x < width; x++)
+    {
+        if (Renderer_IsColumnSkipped(columnMask, x)) continue;
+
+        const RayQuery query = RayQuery_FromDirection(camera->position, Renderer_GetRayDirection(camera, x, width), std::numeric_limits<double>::max());
+        Ray_Cast(level, &query, &hits[x]);
+        zBuffer[x] = hits[x].distance;
+    }
+}
+
+// Renderer_CastWalls for a whole view, taking what it can from the scratch's
+// angular ray cache when there is one. Returns a mask of the columns whose rays
+// were actually cast, nullptr when all of them were.
+inline const uint8_t* Renderer_CastViewWalls(const Level* level, const Camera* camera, const int width, RayHit* hits, double* zBuffer, RenderScratch* scratch)
+{
+    AngularRayCache* cache = scratch->rayCache;
+    if (cache == nullptr)
+    {
+        Renderer_CastWalls(level, camera, width, hits, zBuffer);
+        return nullptr;
+    }
+
+    uint8_t* castColumns = FrameArena_AllocArray<uint8_t>(&scratch->arena, width);
+
+    // The plane is perpendicular to the direction, so the cross product is its signed length times |direction|
+    const double planeRatio = (camera->direction.x * camera->plane.y - camera->direction.y * camera->plane.x) /
+                              (camera->direction.x * camera->direction.x + camera->direction.y * camera->direction.y);
+    AngularRayCache_Begin(cache, level, camera->position, camera->direction, planeRatio, width);
+    for (int x = 0; x < width; x++)
+    {
+        const Vector rayDirection = Renderer_GetRayDirection(camera, x, width);
+        const int bucket = AngularRayCache_GetBucket(cache, x);
+        const AngularRayEntry* entry = AngularRayCache_Find(cache, bucket);
+
+        castColumns[x] = 0;
+        if (entry != nullptr && AngularRayCache_Resolve(level, camera->position, rayDirection, entry, &hits[x]))
+        {
+            cache->reusedRays++;
+        }
+        else
+        {
+            const RayQuery query = RayQuery_FromDirection(camera->position, rayDirection, std::numeric_limits<double>::max());
+            Ray_Cast(level, &query, &hits[x]);
+            castColumns[x] = 1;
+            cache->castRays++;
+
+            if (hits[x].hit)
+            {
+                AngularRayCache_Store(cache, bucket, &hits[x]);
+            }
+        }
+        zBuffer[x] = hits[x].distance;
+    }
+    return castColumns;
+}
+
+// Rows [drawStart, drawEnd) a wall at the given perpendicular distance covers.
+inline void Renderer_GetWallSpan(const int height, const double perpWallDist, int* lineHeight, int* drawStart, int* drawEnd)
+{
+    *lineHeight = static_cast<int>((height / perpWallDist));
+
+    *drawStart = -*lineHeight / 2 + height / 2;
+    if (*drawStart < 0)
+    {
+        *drawStart = 0;
+    }
+
+    *drawEnd = *lineHeight / 2 + height / 2;
+    if (*drawEnd >= height)
+    {
+        *drawEnd = height - 1;
+    }
+}
+
+template<typename Layout = RowMajorLayout, typename Shader>
+void Renderer_DrawWalls(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                        const RayHit* hits, const uint8_t* columnMask = nullptr, RenderStats* stats = nullptr)
+{
+    const Vector& position = camera->position;
+    const Layout layout = {width, height};
+
+    for (int x = 0; x < width; x++)
+    {
+        if (Renderer_IsColumnSkipped(columnMask, x) || !hits[x].hit) continue;
+
+        const Vector rayDirection = Renderer_GetRayDirection(camera, x, width);
+        const IVector mapPosition = hits[x].cell;
+        const int side = hits[x].side;
+        const double perpWallDist = hits[x].distance;
+
+        int lineHeight, drawStart, drawEnd;
+        Renderer_GetWallSpan(height, perpWallDist, &lineHeight, &drawStart, &drawEnd);
+
+        const int texNum = Level_GetWall(level, mapPosition.x, mapPosition.y) - 1;
+        const Texture& tex = level->textures[texNum];
+
+        double wallX;
+        if (side == 0)
+        {
+            wallX = position.y + perpWallDist * rayDirection.y;
+        }
+        else
+        {
+            wallX = position.x + perpWallDist * rayDirection.x;
+        }
+        wallX -= std::floor(wallX);
+
+        int texX = static_cast<int>(wallX * tex.width);
+        if (side == 0 && rayDirection.x > 0) texX = tex.width - texX - 1;
+        if (side == 1 && rayDirection.y < 0) texX = tex.width - texX - 1;
+
+        const double texStep = 1.0 * tex.height / lineHeight;
+        double texPos = (drawStart - height / 2 + lineHeight / 2) * texStep;
+
+        double shadingPerc = std::min(perpWallDist / MAX_VIEW_DIST, 0.75);
+        double lightValue = Level_GetLight(level, mapPosition.x, mapPosition.y);
+        const auto shade = shader.MakeShade(shadingPerc, lightValue);
+
+        Sampler_Dispatch(tex, [&](const auto sampler)
+        {
+            for (int y = drawStart; y < drawEnd; y++)
+            {
+                const int texY = sampler.WrapY(static_cast<int>(texPos));
+                texPos += texStep;
+                buffer[layout.Index(x, y)] = shader.Apply(tex, sampler.Index(texX, texY), shade);
+                RENDER_STATS_PIXEL(stats, RENDER_PASS_WALLS, y * width + x);
+            }
+        });
+        RENDER_STATS_ADD(stats, texelFetches, std::max(drawEnd - drawStart, 0));
+    }
+}
+
+// Distance along a ray below which a floor point, walking back towards the camera,
+// has left the cell [cell, cell + 1) on one axis. Not positive when it never does.
+inline double Renderer_GetCellEntryDistance(const double origin, const double direction, const int cell)
+{
+    if (direction > 0)
+    {
+        return (cell - origin) / direction;
+    }
+    if (direction < 0)
+    {
+        return (cell + 1 - origin) / direction;
+    }
+    return 0;
+}
+
+// Column-major counterpart of Renderer_DrawFloorAndCeiling. Each column is cast
+// from the horizon down, starting below the wall its ray hit (and mirrored for the
+// ceiling above it), so nothing the wall pass covers gets shaded. The column is
+// split into runs of rows that see the same map cell, textures and lights are
+// looked up once per run. Row distances come from a per-row table, and shades
+// from per-row caches that only recompute when the light changes.
+template<typename Shader>
+void Renderer_DrawFloorAndCeilingColumns(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height,
+                                         const RayHit* hits, RenderScratch* scratch, const uint8_t* columnMask = nullptr)
+{
+    const Vector& position = camera->position;
+    const ColumnMajorLayout layout = {width, height};
+    const double positionZ = 0.5 * height;
+    RenderStats* stats = scratch->stats;
+
+    constexpr double fractionScale = 4294967296.0;
+
+    struct RowShade
+    {
+        double lightValue;
+        typename Shader::Shade shade;
+    };
+
+    double* rowDistances = FrameArena_AllocArray<double>(&scratch->arena, height);
+    double* rowShadingPercs = FrameArena_AllocArray<double>(&scratch->arena, height);
+    RowShade* floorShades = FrameArena_AllocArray<RowShade>(&scratch->arena, height);
+    RowShade* ceilingShades = FrameArena_AllocArray<RowShade>(&scratch->arena, height);
+    for (int y = height / 2; y < height; y++)
+    {
+        const int p = std::max(y - height / 2, 1);
+        rowDistances[y] = positionZ / p;
+        rowShadingPercs[y] = std::clamp(1 - p / positionZ - 0.25, 0.0, 0.75);
+        floorShades[y].lightValue = std::numeric_limits<double>::quiet_NaN();
+        ceilingShades[y].lightValue = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    const auto getShade = [&](RowShade* shades, const int y, const double lightValue) -> const typename Shader::Shade&
+    {
+        RowShade& entry = shades[y];
+        if (entry.lightValue != lightValue)
+        {
+            entry.lightValue = lightValue;
+            entry.shade = shader.MakeShade(rowShadingPercs[y], lightValue);
+        }
+        return entry.shade;
+    };
+
+    for (int x = 0; x < width; x++)
+    {
+        if (Renderer_IsColumnSkipped(columnMask, x)) continue;
+
+        const Vector rayDirection = Renderer_GetRayDirection(camera, x, width);
+
+        int floorStart = height / 2;
+        int ceilingStart = height / 2;
+        if (hits[x].hit)
+        {
+            int lineHeight, drawStart, drawEnd;
+            Renderer_GetWallSpan(height, hits[x].distance, &lineHeight, &drawStart, &drawEnd);
+            floorStart = std::max(floorStart, drawEnd);
+            ceilingStart = std::max(ceilingStart, height - drawStart);
+        }
+
+        auto column = buffer + layout.Index(x, 0);
+
+        // Position of the floor point seen at the given row within worldCell, as 32-bit fractions
+        const auto castRow = [&](const int y, const IVector worldCell, uint32_t* u, uint32_t* v)
+        {
+            *u = static_cast<uint32_t>(static_cast<int64_t>((position.x + rowDistances[y] * rayDirection.x - worldCell.x) * fractionScale));
+            *v = static_cast<uint32_t>(static_cast<int64_t>((position.y + rowDistances[y] * rayDirection.y - worldCell.y) * fractionScale));
+        };
+
+        int y = std::min(floorStart, ceilingStart);
+        while (y < height)
+        {
+            const IVector worldCell = {
+                static_cast<int>(std::floor(position.x + rowDistances[y] * rayDirection.x)),
+                static_cast<int>(std::floor(position.y + rowDistances[y] * rayDirection.y))
+            };
+
+            // The run lasts while the row distance stays above the distance the cell was entered at
+            const double entryDistance = std::max(Renderer_GetCellEntryDistance(position.x, rayDirection.x, worldCell.x),
+                                                  Renderer_GetCellEntryDistance(position.y, rayDirection.y, worldCell.y));
+            int runEnd = height;
+            if (entryDistance > 0)
+            {
+                runEnd = std::max(y + 1, static_cast<int>(std::min(std::floor(positionZ / entryDistance) + height / 2 + 1, static_cast<double>(height))));
+            }
+
+            const IVector cell = {PosMod(worldCell.x, level->mapWidth), PosMod(worldCell.y, level->mapHeight)};
+
+            const Texture* floorTexture = &level->textures[Level_GetFloor(level, cell.x, cell.y)];
+            const double floorLight = Level_GetLight(level, cell.x, cell.y);
+
+            const int ceilingTexIndex = Level_GetCeiling(level, cell.x, cell.y);
+            const Texture* ceilingTexture = ceilingTexIndex > 0 ? &level->textures[ceilingTexIndex] : nullptr;
+            const double ceilingLight = Level_GetCeilingLight(level, cell.x, cell.y);
+
+            Sampler_Dispatch(*floorTexture, [&](const auto sampler)
+            {
+                for (int row = std::max(y, floorStart); row < runEnd; row++)
+                {
+                    uint32_t u, v;
+                    castRow(row, worldCell, &u, &v);
+                    column[row] = shader.Apply(*floorTexture, sampler.Index(sampler.ScaleX(u), sampler.ScaleY(v)), getShade(floorShades, row, floorLight));
+                    RENDER_STATS_PIXEL(stats, RENDER_PASS_FLOOR, row * width + x);
+                    RENDER_STATS_ADD(stats, texelFetches, 1);
+                }
+            });
+
+            if (ceilingTexture != nullptr)
+            {
+                Sampler_Dispatch(*ceilingTexture, [&](const auto sampler)
+                {
+                    for (int row = std::max(y, ceilingStart); row < runEnd; row++)
+                    {
+                        uint32_t u, v;
+                        castRow(row, worldCell, &u, &v);
+                        column[height - row - 1] = shader.Apply(*ceilingTexture, sampler.Index(sampler.ScaleX(u), sampler.ScaleY(v)), getShade(ceilingShades, row, ceilingLight));
+                        RENDER_STATS_PIXEL(stats, RENDER_PASS_CEILING, (height - row - 1) * width + x);
+                        RENDER_STATS_ADD(stats, texelFetches, 1);
+                    }
+                });
+            }
+
+            y = runEnd;
+        }
+    }
+}
+
+// Where a thing lands on screen: its camera-space position, the column of its
+// centre, its unclipped size and the clipped rectangle it is drawn in.
+struct SpriteProjection
+{
+    Vector transform;
+    int screenX;
+    int spriteWidth, spriteHeight;
+    int drawStartX, drawEndX;
+    int drawStartY, drawEndY;
+};
+
+// False when the thing is behind the camera.
+inline bool Renderer_ProjectSprite(const Camera* camera, const Vector thingPosition, const int width, const int height, SpriteProjection* projection)
+{
+    const Vector& position = camera->position;
+    const Vector& direction = camera->direction;
+    const Vector& plane = camera->plane;
+
+    Vector spritePosition = {thingPosition.x - position.x, thingPosition.y - position.y};
+
+    double invDet = 1.0 / (plane.x * direction.y - direction.x * plane.y);
+    Vector transform = {
+        invDet * (direction.y * spritePosition.x - direction.x * spritePosition.y),
+        invDet * (-plane.y * spritePosition.x + plane.x * spritePosition.y)
+    };
+
+    if (transform.y <= 0)
+    {
+        return false;
+    }
+
+    int spriteScreenX = static_cast<int>(width / 2 * (1 + transform.x / transform.y));
+
+    int spriteHeight = std::abs(static_cast<int>(height / transform.y));
+    int drawStartY = -spriteHeight / 2 + height / 2;
+    if (drawStartY < 0)
+    {
+        drawStartY = 0;
+    }
+    int drawEndY = spriteHeight / 2 + height / 2;
+    if (drawEndY >= height)
+    {
+        drawEndY = height - 1;
+    }
+
+    int spriteWidth = std::abs(static_cast<int>(height / transform.y));
+    int drawStartX = -spriteWidth / 2 + spriteScreenX;
+    if (drawStartX < 0)
+    {
+        drawStartX = 0;
+    }
+    int drawEndX = spriteWidth / 2 + spriteScreenX;
+    if (drawEndX >= width)
+    {
+        drawEndX = width - 1;
+    }
+
+    *projection = {transform, spriteScreenX, spriteWidth, spriteHeight, drawStartX, drawEndX, drawStartY, drawEndY};
+    return true;
+}
+
+// Draws the level things back to front. Expects scratch->depthHierarchy to be built over the wall pass.
+template<typename Layout = RowMajorLayout, typename Shader>
+void Renderer_DrawSprites(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height, RenderScratch* scratch,
+                          const uint8_t* columnMask = nullptr)
+{
+    const Vector& position = camera->position;
+
+    const int thingCount = level->thingCount;
+    int* spriteOrder = FrameArena_AllocArray<int>(&scratch->arena, thingCount);
+    double* spriteDistance = FrameArena_AllocArray<double>(&scratch->arena, thingCount);
+    auto sortBuffer = FrameArena_AllocArray<std::pair<double, int>>(&scratch->arena, thingCount);
+    const DepthHierarchy* depthHierarchy = &scratch->depthHierarchy;
+    RenderStats* stats = scratch->stats;
+    const Layout layout = {width, height};
+
+    for (int i = 0; i < thingCount; i++)
+    {
+        spriteOrder[i] = i;
+        auto spriteXDist = position.x - level->things[i].position.x;
+        auto spriteYDist = position.y - level->things[i].position.y;
+        spriteDistance[i] = std::sqrt(spriteXDist * spriteXDist + spriteYDist * spriteYDist);
+    }
+
+    sortSprites(spriteOrder, spriteDistance, thingCount, sortBuffer);
+
+    for (int i = 0; i < thingCount; i++)
+    {
+        Thing currentSprite = level->things[spriteOrder[i]];
+        const Texture& tex = level->textures[currentSprite.textureIndex];
+
+        SpriteProjection projection;
+        if (!Renderer_ProjectSprite(camera, currentSprite.position, width, height, &projection))
+        {
+            continue;
+        }
+        RENDER_STATS_ADD(stats, spritesConsidered, 1);
+
+        const Vector transform = projection.transform;
+        const int spriteScreenX = projection.screenX;
+        const int spriteWidth = projection.spriteWidth;
+        const int spriteHeight = projection.spriteHeight;
+        const int drawStartX = projection.drawStartX;
+        const int drawEndX = projection.drawEndX;
+        const int drawStartY = projection.drawStartY;
+        const int drawEndY = projection.drawEndY;
+
+        if (DepthHierarchy_IsOccluded(depthHierarchy, drawStartX, drawEndX, transform.y))
+        {
+            RENDER_STATS_ADD(stats, zBufferRejections, std::max(drawEndX - drawStartX, 0));
+            continue;
+        }
+
+        double shadingPerc = std::min(spriteDistance[i] / MAX_VIEW_DIST, 0.75);
+        double lightValue = Level_GetLight(level, static_cast<int>(currentSprite.position.x), static_cast<int>(currentSprite.position.y));
+        const auto shade = shader.MakeShade(shadingPerc, lightValue);
+
+        // Walk only the runs of stripes where the sprite is in front of the walls
+        int stripe = DepthHierarchy_FindFirstVisible(depthHierarchy, drawStartX, drawEndX, transform.y);
+        RENDER_STATS_ADD(stats, spritesDrawn, stripe < drawEndX);
+        RENDER_STATS_ADD(stats, zBufferRejections, stripe - drawStartX);
+        Sampler_Dispatch(tex, [&](const auto sampler)
+        {
+            while (stripe < drawEndX)
+            {
+                const int runEnd = DepthHierarchy_FindFirstHidden(depthHierarchy, stripe, drawEndX, transform.y);
+
+                for (; stripe < runEnd; stripe++)
+                {
+                    if (Renderer_IsColumnSkipped(columnMask, stripe)) continue;
+
+                    int texX = 256 * (stripe - (-spriteWidth / 2 + spriteScreenX)) * sampler.GetWidth() / spriteWidth / 256;
+
+                    for (int y = drawStartY; y < drawEndY; y++)
+                    {
+                        int d = y * 256 - height * 128 + spriteHeight * 128;
+                        int texY = d * sampler.GetHeight() / spriteHeight / 256;
+                        if (!shader.IsTransparent(tex, sampler.Index(texX, texY)))
+                        {
+                            buffer[layout.Index(stripe, y)] = shader.Apply(tex, sampler.Index(texX, texY), shade);
+                            RENDER_STATS_PIXEL(stats, RENDER_PASS_SPRITES, y * width + stripe);
+                        }
+                    }
+                    RENDER_STATS_ADD(stats, texelFetches, std::max(drawEndY - drawStartY, 0));
+                }
+
+                stripe = DepthHierarchy_FindFirstVisible(depthHierarchy, runEnd, drawEndX, transform.y);
+                RENDER_STATS_ADD(stats, zBufferRejections, stripe - runEnd);
+            }
+        });
+    }
+}
+
+// Renders the full first-person view of one camera into a width * height buffer of the shader's output pixels.
+template<typename Shader>
+void Renderer_DrawViewWith(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height, RenderScratch* scratch)
+{
+    double* zBuffer = FrameArena_AllocArray<double>(&scratch->arena, width);
+    RayHit* hits = FrameArena_AllocArray<RayHit>(&scratch->arena, width);
+
+    std::fill_n(buffer, width * height, 0);
+
+    const uint8_t* castColumns = Renderer_CastViewWalls(level, camera, width, hits, zBuffer, scratch);
+    RENDER_STATS_RAYS(scratch->stats, camera->position, hits, width, castColumns);
+    Renderer_DrawSky(shader, level, camera, buffer, width, height, nullptr, scratch->stats);
+    Renderer_DrawFloorAndCeiling(shader, level, camera, buffer, width, height, nullptr, scratch->stats);
+    Renderer_DrawWalls(shader, level, camera, buffer, width, height, hits, nullptr, scratch->stats);
+    DepthHierarchy_Build(&scratch->depthHierarchy, zBuffer, width);
+    Renderer_DrawSprites(shader, level, camera, buffer, width, height, scratch);
+}
+
+// Column-major render path: the passes write whole contiguous columns into a
+// column-major buffer from the arena, which is transposed into the row-major
+// buffer at the end. Every pixel is covered by exactly one of sky, floor,
+// ceiling or wall, so the column buffer needs no clearing.
+template<typename Shader>
+void Renderer_DrawViewTransposed(const Shader& shader, const Level* level, const Camera* camera, typename Shader::Output* buffer, const int width, const int height, RenderScratch* scratch)
+{
+    using Output = typename Shader::Output;
+
+    double* zBuffer = FrameArena_AllocArray<double>(&scratch->arena, width);
+    RayHit* hits = FrameArena_AllocArray<RayHit>(&scratch->arena, width);
+    Output* columns = FrameArena_AllocArray<Output>(&scratch->arena, width * height);
+
+    const uint8_t* castColumns = Renderer_CastViewWalls(level, camera, width, hits, zBuffer, scratch);
+    RENDER_STATS_RAYS(scratch->stats, camera->position, hits, width, castColumns);
+    Renderer_DrawSky<ColumnMajorLayout>(shader, level, camera, columns, width, height, nullptr, scratch->stats);
+    Renderer_DrawFloorAndCeilingColumns(shader, level, camera, columns, width, height, hits, scratch);
+    Renderer_DrawWalls<ColumnMajorLayout>(shader, level, camera, columns, width, height, hits, nullptr, scratch->stats);
+    DepthHierarchy_Build(&scratch->depthHierarchy, zBuffer, width);
+    Renderer_DrawSprites<ColumnMajorLayout>(shader, level, camera, columns, width, height, scratch);
+
+    Framebuffer_Transpose(columns, buffer, width, height);
+}
+
+inline void Renderer_DrawView(const Level* level, const Camera* camera, uint32_t* buffer, const int width, const int height, RenderScratch* scratch)
+{
+    Renderer_DrawViewWith(RgbaShader{}, level, camera, buffer, width, height, scratch);
+}
+
+// Indexed render path: every pass writes palette indices, Palette_Expand turns the result into pixels.
+// Needs the level textures quantized with Palette_QuantizeTexture.
+inline void Renderer_DrawViewIndexed(const Level* level, const Camera* camera, const Palette* palette, uint8_t* buffer, const int width, const int height, RenderScratch* scratch)
+{
+    Renderer_DrawViewWith(IndexedShader{palette}, level, camera, buffer, width, height, scratch);
+}
+
+inline void Renderer_DrawCameraView(const Level* level, const Camera* camera, View* view, RenderScratch* scratch)
+{
+    FrameArena_Reset(&scratch->arena);
+
+    switch (view->format)
+    {
+        case VIEW_FORMAT_RGBA:
+        {
+            Renderer_DrawView(level, camera, static_cast<uint32_t*>(view->pixels), view->width, view->height, scratch);
+            break;
+        }
+        case VIEW_FORMAT_GRAYSCALE:
+        {
+            const int pixelCount = view->width * view->height;
+            uint32_t* color = FrameArena_AllocArray<uint32_t>(&scratch->arena, pixelCount);
+            Renderer_DrawView(level, camera, color, view->width, view->height, scratch);
+
+            const auto gray = static_cast<uint8_t*>(view->pixels);
+            for (int i = 0; i < pixelCount; i++)
+            {
+                Pixel p;
+                p.rgba = color[i];
+                gray[i] = static_cast<uint8_t>((p.r * 77 + p.g * 150 + p.b * 29) >> 8);
+            }
+            break;
+        }
+        case VIEW_FORMAT_DEPTH:
+        {
+            double* zBuffer = FrameArena_AllocArray<double>(&scratch->arena, view->width);
+            RayHit* hits = FrameArena_AllocArray<RayHit>(&scratch->arena, view->width);
+            Renderer_CastWalls(level, camera, view->width, hits, zBuffer);
+            RENDER_STATS_RAYS(scratch->stats, camera->position, hits, view->width, nullptr);
+
+            const auto depth = static_cast<float*>(view->pixels);
+            for (int x = 0; x < view->width; x++)
+            {
+                depth[x] = static_cast<float>(zBuffer[x]);
+            }
+            break;
+        }
+    }
+}
+
+// Renders cameras[i] into views[i] for every i in [0, viewCount). Level and texture
+// data are shared read-only, views are spread across the pool's threads.
+// scratch must hold one entry per pool thread.
+inline void Renderer_DrawViews(const Level* level, const Camera* cameras, View* views, const int viewCount, JobPool* pool, RenderScratch* scratch)
+{
+    pool->ParallelFor(viewCount, [&](const int index, const int worker)
+    {
+        Renderer_DrawCameraView(level, &cameras[index], &views[index], &scratch[worker]);
+    });
+}
+
+#endif
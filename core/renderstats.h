@@ -0,0 +1,192 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+#include "include.h"
+#include "structures.h"
+#include "raycast.h"
+
+// Workload counters of the renderer. Counting only happens while RENDER_STATS
+// is defined, otherwise the RENDER_STATS_* macros expand to no-ops and the
+// passes carry no extra work. The renderer counts into the RenderStats its
+// scratch points at, a null pointer disables counting for that scratch.
+
+enum RenderPass
+{
+    RENDER_PASS_SKY,
+    RENDER_PASS_FLOOR,
+    RENDER_PASS_CEILING,
+    RENDER_PASS_WALLS,
+    RENDER_PASS_SPRITES,
+    RENDER_PASS_REPROJECTION, // columns copied from the previous frame by the interlaced renderer
+    RENDER_PASS_COUNT
+};
+
+inline const char* RenderPass_GetName(const RenderPass pass)
+{
+    switch (pass)
+    {
+        case RENDER_PASS_SKY: return "sky";
+        case RENDER_PASS_FLOOR: return "floor";
+        case RENDER_PASS_CEILING: return "ceiling";
+        case RENDER_PASS_WALLS: return "walls";
+        case RENDER_PASS_SPRITES: return "sprites";
+        case RENDER_PASS_REPROJECTION: return "reprojection";
+        default: return "?";
+    }
+}
+
+enum HeatmapMode
+{
+    HEATMAP_OFF,
+    HEATMAP_OVERDRAW,  // writes per pixel
+    HEATMAP_DDA_STEPS, // grid cells walked by each column's ray
+    HEATMAP_MODE_COUNT
+};
+
+struct RenderCounters
+{
+    uint64_t raysCast;
+    uint64_t ddaSteps;
+    uint64_t texelFetches;
+    uint64_t pixelsWritten[RENDER_PASS_COUNT];
+    uint64_t spritesConsidered; // things in front of the camera
+    uint64_t spritesDrawn;      // of those, the ones with at least one visible stripe
+    uint64_t zBufferRejections; // sprite stripes hidden behind walls, whole culled sprites included
+};
+
+// Counters plus the per-column and per-pixel buffers the heatmaps are drawn from.
+// The buffers keep their size between frames, so counting does not allocate once
+// the view size is stable.
+struct RenderStats
+{
+    RenderCounters counters;
+    int width, height;
+    std::vector<int> columnSteps;
+    std::vector<uint8_t> overdraw;
+};
+
+#ifdef RENDER_STATS
+#define RENDER_STATS_ADD(stats, counter, amount) do { if ((stats) != nullptr) (stats)->counters.counter += (amount); } while (0)
+#define RENDER_STATS_PIXEL(stats, pass, index) do { if ((stats) != nullptr) RenderStats_CountPixel((stats), (pass), (index)); } while (0)
+#define RENDER_STATS_RAYS(stats, origin, hits, width, columnMask) do { if ((stats) != nullptr) RenderStats_CountRays((stats), (origin), (hits), (width), (columnMask)); } while (0)
+#else
+#define RENDER_STATS_ADD(stats, counter, amount) ((void)sizeof(stats))
+#define RENDER_STATS_PIXEL(stats, pass, index) ((void)sizeof(stats))
+#define RENDER_STATS_RAYS(stats, origin, hits, width, columnMask) ((void)sizeof(stats), (void)sizeof(columnMask))
+#endif
+
+inline bool RenderStats_IsEnabled()
+{
+#ifdef RENDER_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Clears the counters and buffers for a view of the given size.
+inline void RenderStats_Begin(RenderStats* stats, const int width, const int height)
+{
+    stats->counters = {};
+    stats->width = width;
+    stats->height = height;
+    stats->columnSteps.assign(width, 0);
+    stats->overdraw.assign(static_cast<size_t>(width) * height, 0);
+}
+
+inline void RenderStats_CountPixel(RenderStats* stats, const RenderPass pass, const int index)
+{
+    stats->counters.pixelsWritten[pass]++;
+    uint8_t& overdraw = stats->overdraw[index];
+    if (overdraw < std::numeric_limits<uint8_t>::max())
+    {
+        overdraw++;
+    }
+}
+
+// A DDA moves one cell along one axis per step, so the steps a ray took are the
+// Manhattan distance between the cell it started in and the one it stopped in.
+inline void RenderStats_CountRays(RenderStats* stats, const Vector origin, const RayHit* hits, const int width, const uint8_t* columnMask)
+{
+    const IVector start = {static_cast<int>(std::floor(origin.x)), static_cast<int>(std::floor(origin.y))};
+    for (int x = 0; x < width; x++)
+    {
+        if (columnMask != nullptr && columnMask[x] == 0) continue;
+
+        const int steps = std::abs(hits[x].cell.x - start.x) + std::abs(hits[x].cell.y - start.y);
+        stats->columnSteps[x] += steps;
+        stats->counters.raysCast++;
+        stats->counters.ddaSteps += steps;
+    }
+}
+
+inline uint64_t RenderCounters_GetPixelsWritten(const RenderCounters* counters)
+{
+    uint64_t total = 0;
+    for (const uint64_t pixels: counters->pixelsWritten)
+    {
+        total += pixels;
+    }
+    return total;
+}
+
+inline void RenderCounters_Accumulate(RenderCounters* total, const RenderCounters* frame)
+{
+    total->raysCast += frame->raysCast;
+    total->ddaSteps += frame->ddaSteps;
+    total->texelFetches += frame->texelFetches;
+    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++)
+    {
+        total->pixelsWritten[pass] += frame->pixelsWritten[pass];
+    }
+    total->spritesConsidered += frame->spritesConsidered;
+    total->spritesDrawn += frame->spritesDrawn;
+    total->zBufferRejections += frame->zBufferRejections;
+}
+
+// Black - blue - green - yellow - red ramp for t in [0, 1].
+inline Pixel Heatmap_GetColor(const double t)
+{
+    constexpr uint8_t ramp[5][3] = {{0, 0, 0}, {0, 0, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+
+    const double scaled = std::clamp(t, 0.0, 1.0) * 4;
+    const int i = std::min(static_cast<int>(scaled), 3);
+    const double f = scaled - i;
+
+    Pixel p;
+    p.r = static_cast<uint8_t>(ramp[i][0] + (ramp[i + 1][0] - ramp[i][0]) * f);
+    p.g = static_cast<uint8_t>(ramp[i][1] + (ramp[i + 1][1] - ramp[i][1]) * f);
+    p.b = static_cast<uint8_t>(ramp[i][2] + (ramp[i + 1][2] - ramp[i][2]) * f);
+    p.a = 0xFF;
+    return p;
+}
+
+// Renders a heatmap of the last counted view into width * height pixels laid out
+// like Pixel. Overdraw saturates at four writes per pixel, DDA steps are scaled
+// to the longest ray of the frame and fill whole columns.
+inline void RenderStats_DrawHeatmap(const RenderStats* stats, const HeatmapMode mode, Pixel* pixels)
+{
+    const int width = stats->width;
+    const int height = stats->height;
+
+    if (mode == HEATMAP_OVERDRAW)
+    {
+        for (int i = 0; i < width * height; i++)
+        {
+            pixels[i] = Heatmap_GetColor(stats->overdraw[i] / 4.0);
+        }
+    }
+    else if (mode == HEATMAP_DDA_STEPS)
+    {
+        const int maxSteps = std::max(1, *std::max_element(stats->columnSteps.begin(), stats->columnSteps.end()));
+        for (int x = 0; x < width; x++)
+        {
+            const Pixel color = Heatmap_GetColor(static_cast<double>(stats->columnSteps[x]) / maxSteps);
+            for (int y = 0; y < height; y++)
+            {
+                pixels[y * width + x] = color;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+#include "include.h"
+#include "structures.h"
+
+// Texel addressing for one texture. The passes run their inner loops on a
+// sampler type picked per texture by Sampler_Dispatch: the common power-of-two
+// sizes get a sampler with the size baked in, so wrapping is a mask and row
+// offsets are shifts, everything else goes through GenericSampler, which wraps
+// with a modulo and is correct for any size.
+
+// Sizes with a specialized sampler, as log2: 64, 128 and 256.
+#define SAMPLER_MIN_LOG2 6
+#define SAMPLER_MAX_LOG2 8
+
+template<int WidthLog2, int HeightLog2>
+struct PotSampler
+{
+    static constexpr int Width = 1 << WidthLog2;
+    static constexpr int Height = 1 << HeightLog2;
+
+    int GetWidth() const { return Width; }
+    int GetHeight() const { return Height; }
+
+    int WrapX(const int x) const { return x & (Width - 1); }
+    int WrapY(const int y) const { return y & (Height - 1); }
+
+    int Index(const int x, const int y) const { return y << WidthLog2 | x; }
+
+    // Texel coordinate of a 32-bit fixed-point fraction of the texture size
+    int ScaleX(const uint32_t fraction) const { return static_cast<int>(fraction >> (32 - WidthLog2)); }
+    int ScaleY(const uint32_t fraction) const { return static_cast<int>(fraction >> (32 - HeightLog2)); }
+};
+
+struct GenericSampler
+{
+    int width, height;
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+    int WrapX(const int x) const { return (x % width + width) % width; }
+    int WrapY(const int y) const { return (y % height + height) % height; }
+
+    int Index(const int x, const int y) const { return y * width + x; }
+
+    int ScaleX(const uint32_t fraction) const { return static_cast<int>(static_cast<uint64_t>(fraction) * width >> 32); }
+    int ScaleY(const uint32_t fraction) const { return static_cast<int>(static_cast<uint64_t>(fraction) * height >> 32); }
+};
+
+template<int WidthLog2, int HeightLog2 = SAMPLER_MIN_LOG2, typename F>
+void Sampler_DispatchHeight(const Texture& tex, F&& f)
+{
+    if constexpr (HeightLog2 > SAMPLER_MAX_LOG2)
+    {
+        f(GenericSampler{tex.width, tex.height});
+    }
+    else if (tex.heightLog2 == HeightLog2)
+    {
+        f(PotSampler<WidthLog2, HeightLog2>{});
+    }
+    else
+    {
+        Sampler_DispatchHeight<WidthLog2, HeightLog2 + 1>(tex, f);
+    }
+}
+
+template<int WidthLog2 = SAMPLER_MIN_LOG2, typename F>
+void Sampler_DispatchWidth(const Texture& tex, F&& f)
+{
+    if constexpr (WidthLog2 > SAMPLER_MAX_LOG2)
+    {
+        f(GenericSampler{tex.width, tex.height});
+    }
+    else if (tex.widthLog2 == WidthLog2)
+    {
+        Sampler_DispatchHeight<WidthLog2>(tex, f);
+    }
+    else
+    {
+        Sampler_DispatchWidth<WidthLog2 + 1>(tex, f);
+    }
+}
+
+// Calls f with the sampler for the texture's size class.
+template<typename F>
+void Sampler_Dispatch(const Texture& tex, F&& f)
+{
+    Sampler_DispatchWidth(tex, f);
+}
+
+#endif
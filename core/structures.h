@@ -20,21 +20,60 @@ struct Texture
     SDL_Texture* tex;
     int width, height;
     Pixel* pixels;
+    uint8_t* indexedPixels;
+
+    // Size class: log2 of width and height, -1 when not a power of two
+    int widthLog2 = -1, heightLog2 = -1;
+
+    // pixels and indexedPixels point into memory the texture does not own, such as an asset segment
+    bool sharedPixels = false;
 };
 
+inline int Texture_GetSizeLog2(const int size)
+{
+    if (size <= 0 || (size & (size - 1)) != 0)
+    {
+        return -1;
+    }
+
+    int log2 = 0;
+    while ((1 << log2) < size)
+    {
+        log2++;
+    }
+    return log2;
+}
+
+inline void Texture_UpdateSizeClass(Texture* texture)
+{
+    texture->widthLog2 = Texture_GetSizeLog2(texture->width);
+    texture->heightLog2 = Texture_GetSizeLog2(texture->height);
+}
+
 inline void Texture_Free(Texture* texture)
 {
     if (texture != nullptr)
     {
         SDL_DestroyTexture(texture->tex);
         texture->tex = nullptr;
+        if (!texture->sharedPixels)
+        {
+            delete[] texture->pixels;
+            delete[] texture->indexedPixels;
+        }
         texture->pixels = nullptr;
+        texture->indexedPixels = nullptr;
+        texture->sharedPixels = false;
         texture->width = 0;
         texture->height = 0;
+        texture->widthLog2 = -1;
+        texture->heightLog2 = -1;
     }
 }
 
-inline bool Texture_FromFile(Texture* texture, SDL_Window* window, SDL_Renderer* renderer, std::string path)
+// Loads the image at path into the texture's pixels, converted to pixelFormat,
+// without creating an SDL texture. Returns the converted surface, the caller frees it.
+inline SDL_Surface* Texture_LoadPixels(Texture* texture, const std::string& path, const Uint32 pixelFormat)
 {
     SDL_Surface* loadedSurface = IMG_Load(path.c_str());
 
@@ -45,16 +84,17 @@ inline bool Texture_FromFile(Texture* texture, SDL_Window* window, SDL_Renderer*
 
     SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0x00, 0x00, 0x00 ) );
 
-    SDL_Surface* optimizedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_GetWindowPixelFormat(window), 0);
+    SDL_Surface* optimizedSurface = SDL_ConvertSurfaceFormat(loadedSurface, pixelFormat, 0);
     if (optimizedSurface == nullptr)
     {
         EXIT_LOG_SDL_ERROR("Unable to convert loaded surface to display format!");
     }
 
-    texture->tex = SDL_CreateTextureFromSurface(renderer, optimizedSurface);
     texture->width = optimizedSurface->w;
     texture->height = optimizedSurface->h;
+    Texture_UpdateSizeClass(texture);
     texture->pixels = new Pixel[optimizedSurface->w * optimizedSurface->h];
+    texture->indexedPixels = nullptr;
 
     const auto surfacePixels = static_cast<Pixel*>(optimizedSurface->pixels);
 
@@ -67,6 +107,15 @@ inline bool Texture_FromFile(Texture* texture, SDL_Window* window, SDL_Renderer*
     }
 
     SDL_FreeSurface(loadedSurface);
+    return optimizedSurface;
+}
+
+inline bool Texture_FromFile(Texture* texture, SDL_Window* window, SDL_Renderer* renderer, std::string path)
+{
+    SDL_Surface* optimizedSurface = Texture_LoadPixels(texture, path, SDL_GetWindowPixelFormat(window));
+
+    texture->tex = SDL_CreateTextureFromSurface(renderer, optimizedSurface);
+
     SDL_FreeSurface(optimizedSurface);
     return texture->tex != nullptr;
 }
@@ -94,6 +143,20 @@ struct Thing
 };
 
 
+class ChunkedWorld;
+
+// Read-only view of flat level layers in memory the level does not own, cell
+// (x, y) at x * height + y.
+struct LevelGrid
+{
+    int width, height;
+    const int32_t* walls;
+    const int32_t* floors;
+    const int32_t* ceilings;
+    const double* lights;
+    const double* ceilingLights;
+};
+
 struct Level
 {
     Texture* textures;
@@ -102,7 +165,8 @@ struct Level
     std::vector<std::vector<int>> wallMap;
     std::vector<std::vector<int>> floorMap;
     std::vector<std::vector<int>> ceilingMap;
-    std::vector<std::vector<int>> lightMap;
+    std::vector<std::vector<double>> lightMap;
+    std::vector<std::vector<double>> ceilingLightMap;
 
     int mapWidth;
     int mapHeight;
@@ -112,6 +176,9 @@ struct Level
     Thing* things;
     int thingCount;
 
+    ChunkedWorld* world = nullptr; // when set, cells are paged in from it and the dense maps are unused
+    const LevelGrid* grid = nullptr; // when set, cells are read from it and the dense maps are unused
+    uint64_t revision = 0; // counts edits of the dense maps after setup, light maps included, see Level_MarkEdited
 };
 
 
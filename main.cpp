@@ -1,8 +1,19 @@
 #include <float.h>
+#include <cstring>
+#include <memory>
 
+#define ALLOC_TRACKER_IMPLEMENTATION
+#include "core/alloctracker.h"
 #include "core/include.h"
 #include "core/structures.h"
 #include "core/timer.h"
+#include "core/renderer.h"
+#include "core/interlace.h"
+#include "core/incremental.h"
+#include "core/chunkedworld.h"
+#include "core/assetsegment.h"
+#include "core/benchmark.h"
+#include "core/latency.h"
 
 
 #define MAP_WIDTH 24
@@ -11,13 +22,15 @@
 #define SCREEN_HEIGHT 480
 #define MINIMAP_SIZE 480
 #define MINIMAP_MASK_SIZE 360
-#define MAX_VIEW_DIST 20
+#define WORLD_MAX_RESIDENT_BYTES (64 * 1024 * 1024)
+#define WORLD_FOG_TEXTURE 3
 
 constexpr int GAME_WIDTH = 320;
 constexpr int GAME_HEIGHT = GAME_WIDTH * (SCREEN_WIDTH / SCREEN_HEIGHT);
 
 constexpr int SCREEN_FPS = 60;
-constexpr int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
+constexpr int STATS_REPORT_TICKS = 1000;
+constexpr int ALLOCATION_WARMUP_FRAMES = 120;
 constexpr int TILE_WIDTH = 64;
 constexpr int TILE_HEIGHT = 64;
 constexpr int MINIMAP_TILES_WIDE = MINIMAP_SIZE / TILE_WIDTH;
@@ -52,7 +65,35 @@ std::vector<std::vector<int>> worldMap =
     {2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 5, 5, 5, 5, 5, 5, 5, 5, 5}
 };
 
-int ceilingMap[MAP_WIDTH][MAP_HEIGHT] =
+std::vector<std::vector<int>> floorMap =
+{
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3}
+};
+
+std::vector<std::vector<int>> ceilingMap =
 {
     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
     {0, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0, 0, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0},
@@ -80,7 +121,7 @@ int ceilingMap[MAP_WIDTH][MAP_HEIGHT] =
     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 };
 
-double lightMap[MAP_WIDTH][MAP_HEIGHT] =
+std::vector<std::vector<double>> lightMap =
 {
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
@@ -108,7 +149,7 @@ double lightMap[MAP_WIDTH][MAP_HEIGHT] =
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}
 };
 
-double ceilingLightMap[MAP_WIDTH][MAP_HEIGHT] =
+std::vector<std::vector<double>> ceilingLightMap =
 {
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
@@ -137,9 +178,7 @@ double ceilingLightMap[MAP_WIDTH][MAP_HEIGHT] =
 };
 
 
-Vector position = {22.0, 11.5};
-Vector direction = {-1.0, 0};
-Vector plane = {0, 0.66};
+Camera camera = {{22.0, 11.5}, {-1.0, 0}, {0, 0.66}};
 
 SDL_Window* window = nullptr;
 SDL_Renderer* renderer = nullptr;
@@ -147,13 +186,15 @@ SDL_Texture* gameTexture;
 SDL_Texture* mapTexture;
 SDL_Texture* minimapTargetTexture;
 SDL_Texture* minimapMask;
+SDL_Texture* heatmapTexture;
 
 
 Texture textures[12];
+Level level;
 
 #define NUM_SPRITES 19
 
-Sprite sprite[NUM_SPRITES] =
+Thing things[NUM_SPRITES] =
 {
     {20.5, 11.5, 10}, //green light in front of playerstart
     //green lights in every room
@@ -181,10 +222,53 @@ Sprite sprite[NUM_SPRITES] =
     {10.5, 15.8, 8},
 };
 
-double ZBuffer[GAME_WIDTH];
+RenderScratch renderScratch;
+Palette palette;
+const Palette* renderPalette = &palette;
+
+InterlaceHistory interlaceHistory;
+IncrementalCache incrementalCache;
+AngularRayCache rayCache;
+RenderStats renderStats;
+HeatmapMode heatmapMode = HEATMAP_OFF;
+ChunkedWorld world;
+std::string worldPath;
+std::string exportWorldPath;
+AssetSegment assetSegment;
+std::string publishAssetsName;
+std::string attachAssetsName;
+
+enum BenchmarkMode
+{
+    BENCHMARK_OFF,
+    BENCHMARK_QUICK,
+    BENCHMARK_FULL
+};
 
-int spriteOrder[NUM_SPRITES];
-double spriteDistance[NUM_SPRITES];
+BenchmarkMode benchmarkMode = BENCHMARK_OFF;
+
+// Textures the benchmark levels are built from: the eight wall textures, the
+// barrel, pillar and light sprites, greystone floors and wooden ceilings
+const LevelGenTextures benchmarkTextures = {0, 8, 3, 6, 8, 3};
+
+bool palettized = false;
+bool interlaced = false;
+bool columnMajor = false;
+bool incremental = false;
+bool rayCacheEnabled = false;
+bool deferred = false;
+bool reportStats = false; // the once-a-second stats line, --stats or any build that counts allocations or render stats
+std::unique_ptr<JobPool> shadingPool; // threads of the deferred shading pass
+
+double reportRenderMilliseconds = 0;
+int reportReprojectedColumns = 0;
+RenderCounters reportCounters = {};
+int reportRedrawnColumns = 0;
+int reportSkippedFrames = 0;
+LatencyHistogram reportLatency = {};
+LatencyHistogram sessionLatency = {};
+PendingInput pendingInput = {};
+FramePacer framePacer;
 
 bool quit = false;
 
@@ -254,9 +338,13 @@ void Init()
     mapTexture = SDL_CreateTexture(renderer, SDL_GetWindowPixelFormat(window), SDL_TEXTUREACCESS_TARGET, MINIMAP_SIZE, MINIMAP_SIZE);
     minimapMask = CreateMinimapMask();
     minimapTargetTexture = SDL_CreateTexture(renderer, SDL_GetWindowPixelFormat(window), SDL_TEXTUREACCESS_TARGET, MINIMAP_SIZE, MINIMAP_SIZE);
+    heatmapTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, GAME_WIDTH, GAME_HEIGHT);
+
+    // Started up front so toggling deferred shading does not allocate mid-session
+    shadingPool = std::make_unique<JobPool>();
 }
 
-void Load()
+void LoadFromFiles()
 {
     Texture_FromFile(&textures[0], window, renderer, "textures/eagle.png");
     Texture_FromFile(&textures[1], window, renderer, "textures/redbrick.png");
@@ -270,15 +358,115 @@ void Load()
     Texture_FromFile(&textures[9], window, renderer, "textures/pillar.png");
     Texture_FromFile(&textures[10], window, renderer, "textures/greenlight.png");
     Texture_FromFile(&textures[11], window, renderer, "textures/sky.png");
+
+    level.textures = textures;
+    level.textureCount = 12;
+    level.wallMap = worldMap;
+    level.floorMap = floorMap;
+    level.ceilingMap = ceilingMap;
+    level.lightMap = lightMap;
+    level.ceilingLightMap = ceilingLightMap;
+    level.mapWidth = MAP_WIDTH;
+    level.mapHeight = MAP_HEIGHT;
+    level.skyTexture = 11;
+    level.things = things;
+    level.thingCount = NUM_SPRITES;
+
+    Palette_Build(&palette, textures, 12);
+    for (auto& texture: textures)
+    {
+        Palette_QuantizeTexture(&palette, &texture);
+    }
+
+    if (!publishAssetsName.empty())
+    {
+        // Replaces a segment left behind by an earlier publisher
+        AssetSegment_Unlink(publishAssetsName);
+        if (!AssetSegment_Publish(&assetSegment, publishAssetsName, &level, &palette, SDL_GetWindowPixelFormat(window)))
+        {
+            EXIT_LOG_ERROR(std::format("Unable to publish asset segment {}!", publishAssetsName));
+        }
+    }
+}
+
+// Binds the textures, palette and level to a segment another process published,
+// instead of decoding and converting the assets again.
+void LoadFromAssetSegment()
+{
+    if (!AssetSegment_Attach(&assetSegment, attachAssetsName))
+    {
+        EXIT_LOG_ERROR(std::format("Unable to attach to asset segment {}!", attachAssetsName));
+    }
+
+    const AssetSegmentHeader* header = assetSegment.header;
+    if (header->pixelFormat != SDL_GetWindowPixelFormat(window) || header->textureCount != 12)
+    {
+        EXIT_LOG_ERROR(std::format("Asset segment {} does not match this build!", attachAssetsName));
+    }
+
+    AssetSegment_BindTextures(&assetSegment, textures);
+    for (auto& texture: textures)
+    {
+        texture.tex = SDL_CreateTexture(renderer, header->pixelFormat, SDL_TEXTUREACCESS_STATIC, texture.width, texture.height);
+        SDL_UpdateTexture(texture.tex, nullptr, texture.pixels, texture.width * static_cast<int>(sizeof(Pixel)));
+    }
+
+    level.textures = textures;
+    level.things = things;
+    level.thingCount = NUM_SPRITES;
+    AssetSegment_BindLevel(&assetSegment, &level);
+    renderPalette = AssetSegment_GetPalette(&assetSegment);
+}
+
+void Load()
+{
+    if (!attachAssetsName.empty())
+    {
+        LoadFromAssetSegment();
+    }
+    else
+    {
+        LoadFromFiles();
+    }
+
+    if (RenderStats_IsEnabled())
+    {
+        renderScratch.stats = &renderStats;
+    }
+
+    if (!exportWorldPath.empty() && !ChunkedWorld_WriteFromLevel(exportWorldPath, &level, camera.position, WORLD_FOG_TEXTURE))
+    {
+        EXIT_LOG_ERROR(std::format("Unable to write world file {}!", exportWorldPath));
+    }
+
+    if (!worldPath.empty())
+    {
+        if (!world.Open(worldPath, WORLD_MAX_RESIDENT_BYTES, MAX_VIEW_DIST))
+        {
+            EXIT_LOG_ERROR(std::format("Unable to open world file {}!", worldPath));
+        }
+
+        level.world = &world;
+        level.mapWidth = world.GetWidth();
+        level.mapHeight = world.GetHeight();
+        level.thingCount = 0;
+        camera.position = world.GetSpawn();
+    }
 }
 
 void Close()
 {
+    world.Close();
+    shadingPool.reset();
+
     for (int i = 0; i < 8; i++)
     {
         Texture_Free(&textures[i]);
     }
 
+    // A published segment stays behind for the instances attached to it and those still to start
+    AssetSegment_Detach(&assetSegment);
+
     SDL_DestroyWindow(window);
     window = nullptr;
 
@@ -299,6 +487,83 @@ void Update(const double deltaTime)
         {
             quit = true;
         }
+
+        // The window contents may be gone, skipping the next frame would leave them that way
+        if (e.type == SDL_WINDOWEVENT &&
+            (e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_RESTORED ||
+             e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED))
+        {
+            IncrementalCache_Invalidate(&incrementalCache);
+        }
+
+        const bool isInput = (e.type == SDL_KEYDOWN && !e.key.repeat) || e.type == SDL_KEYUP ||
+                             e.type == SDL_MOUSEMOTION || e.type == SDL_MOUSEBUTTONDOWN;
+        if (isInput)
+        {
+            PendingInput_Add(&pendingInput, e.common.timestamp);
+        }
+
+        if (e.type == SDL_KEYDOWN && !e.key.repeat)
+        {
+            if (e.key.keysym.scancode == SDL_SCANCODE_P)
+            {
+                palettized = !palettized;
+                InterlaceHistory_Invalidate(&interlaceHistory);
+                IncrementalCache_Invalidate(&incrementalCache);
+                printf("palettized rendering: %s\n", palettized ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_I)
+            {
+                interlaced = !interlaced;
+                InterlaceHistory_Invalidate(&interlaceHistory);
+                printf("interlaced rendering: %s\n", interlaced ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_C)
+            {
+                columnMajor = !columnMajor;
+                printf("column-major rendering: %s\n", columnMajor ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_U)
+            {
+                incremental = !incremental;
+                IncrementalCache_Invalidate(&incrementalCache);
+                printf("incremental rendering: %s\n", incremental ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_R)
+            {
+                rayCacheEnabled = !rayCacheEnabled;
+                renderScratch.rayCache = rayCacheEnabled ? &rayCache : nullptr;
+                AngularRayCache_Invalidate(&rayCache);
+                printf("angular ray cache: %s\n", rayCacheEnabled ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_L)
+            {
+                deferred = !deferred;
+                InterlaceHistory_Invalidate(&interlaceHistory);
+                IncrementalCache_Invalidate(&incrementalCache);
+                printf("deferred shading: %s\n", deferred ? "on" : "off");
+            }
+
+            if (e.key.keysym.scancode == SDL_SCANCODE_H)
+            {
+                if (RenderStats_IsEnabled())
+                {
+                    heatmapMode = static_cast<HeatmapMode>((heatmapMode + 1) % HEATMAP_MODE_COUNT);
+                    IncrementalCache_Invalidate(&incrementalCache);
+                    constexpr const char* names[] = {"off", "overdraw", "dda steps"};
+                    printf("heatmap: %s\n", names[heatmapMode]);
+                }
+                else
+                {
+                    printf("heatmap: render stats are not compiled in\n");
+                }
+            }
+        }
     }
 
     const Uint8* currentKeyStates = SDL_GetKeyboardState(nullptr);
@@ -310,98 +575,93 @@ void Update(const double deltaTime)
 
     if (currentKeyStates[SDL_SCANCODE_W])
     {
-        const auto deltaX = position.x + direction.x * moveSpeed;
-        const auto deltaY = position.y + direction.y * moveSpeed;
+        const auto deltaX = camera.position.x + camera.direction.x * moveSpeed;
+        const auto deltaY = camera.position.y + camera.direction.y * moveSpeed;
 
-        if (worldMap[static_cast<int>(deltaX)][static_cast<int>(position.y)] == false)
+        if (Level_GetWall(&level, static_cast<int>(deltaX), static_cast<int>(camera.position.y)) == 0)
         {
-            position.x = deltaX;
+            camera.position.x = deltaX;
         }
-        if (worldMap[static_cast<int>(position.x)][static_cast<int>(deltaY)] == false)
+        if (Level_GetWall(&level, static_cast<int>(camera.position.x), static_cast<int>(deltaY)) == 0)
         {
-            position.y = deltaY;
+            camera.position.y = deltaY;
         }
     }
 
     if (currentKeyStates[SDL_SCANCODE_S])
     {
-        const auto deltaX = position.x - direction.x * moveSpeed;
-        const auto deltaY = position.y - direction.y * moveSpeed;
+        const auto deltaX = camera.position.x - camera.direction.x * moveSpeed;
+        const auto deltaY = camera.position.y - camera.direction.y * moveSpeed;
 
-        if (worldMap[static_cast<int>(deltaX)][static_cast<int>(position.y)] == false)
+        if (Level_GetWall(&level, static_cast<int>(deltaX), static_cast<int>(camera.position.y)) == 0)
         {
-            position.x = deltaX;
+            camera.position.x = deltaX;
         }
-        if (worldMap[static_cast<int>(position.x)][static_cast<int>(deltaY)] == false)
+        if (Level_GetWall(&level, static_cast<int>(camera.position.x), static_cast<int>(deltaY)) == 0)
         {
-            position.y = deltaY;
+            camera.position.y = deltaY;
         }
     }
 
     if (currentKeyStates[SDL_SCANCODE_A])
     {
-        const auto deltaX = position.x - direction.y * moveSpeed;
-        const auto deltaY = position.y - -direction.x * moveSpeed;
+        const auto deltaX = camera.position.x - camera.direction.y * moveSpeed;
+        const auto deltaY = camera.position.y - -camera.direction.x * moveSpeed;
 
-        if (worldMap[static_cast<int>(deltaX)][static_cast<int>(position.y)] == false)
+        if (Level_GetWall(&level, static_cast<int>(deltaX), static_cast<int>(camera.position.y)) == 0)
         {
-            position.x = deltaX;
+            camera.position.x = deltaX;
         }
-        if (worldMap[static_cast<int>(position.x)][static_cast<int>(deltaY)] == false)
+        if (Level_GetWall(&level, static_cast<int>(camera.position.x), static_cast<int>(deltaY)) == 0)
         {
-            position.y = deltaY;
+            camera.position.y = deltaY;
         }
     }
 
     if (currentKeyStates[SDL_SCANCODE_D])
     {
-        const auto deltaX = position.x + direction.y * moveSpeed;
-        const auto deltaY = position.y + -direction.x * moveSpeed;
+        const auto deltaX = camera.position.x + camera.direction.y * moveSpeed;
+        const auto deltaY = camera.position.y + -camera.direction.x * moveSpeed;
 
-        if (worldMap[static_cast<int>(deltaX)][static_cast<int>(position.y)] == false)
+        if (Level_GetWall(&level, static_cast<int>(deltaX), static_cast<int>(camera.position.y)) == 0)
         {
-            position.x = deltaX;
+            camera.position.x = deltaX;
         }
-        if (worldMap[static_cast<int>(position.x)][static_cast<int>(deltaY)] == false)
+        if (Level_GetWall(&level, static_cast<int>(camera.position.x), static_cast<int>(deltaY)) == 0)
         {
-            position.y = deltaY;
+            camera.position.y = deltaY;
         }
     }
 
     if (currentKeyStates[SDL_SCANCODE_LEFT])
     {
-        const double oldDirectionX = direction.x;
+        const double oldDirectionX = camera.direction.x;
         const double cosRot = std::cos(rotationSpeed);
         const double sinRot = std::sin(rotationSpeed);
 
-        direction.x = direction.x * cosRot - direction.y * sinRot;
-        direction.y = oldDirectionX * sinRot + direction.y * cosRot;
+        camera.direction.x = camera.direction.x * cosRot - camera.direction.y * sinRot;
+        camera.direction.y = oldDirectionX * sinRot + camera.direction.y * cosRot;
 
-        const double oldPlaneX = plane.x;
-        plane.x = plane.x * cosRot - plane.y * sinRot;
-        plane.y = oldPlaneX * sinRot + plane.y * cosRot;
+        const double oldPlaneX = camera.plane.x;
+        camera.plane.x = camera.plane.x * cosRot - camera.plane.y * sinRot;
+        camera.plane.y = oldPlaneX * sinRot + camera.plane.y * cosRot;
     }
 
     if (currentKeyStates[SDL_SCANCODE_RIGHT])
     {
-        const double oldDirectionX = direction.x;
+        const double oldDirectionX = camera.direction.x;
         const double cosRot = std::cos(-rotationSpeed);
         const double sinRot = std::sin(-rotationSpeed);
 
-        direction.x = direction.x * cosRot - direction.y * sinRot;
-        direction.y = oldDirectionX * sinRot + direction.y * cosRot;
+        camera.direction.x = camera.direction.x * cosRot - camera.direction.y * sinRot;
+        camera.direction.y = oldDirectionX * sinRot + camera.direction.y * cosRot;
 
-        const double oldPlaneX = plane.x;
-        plane.x = plane.x * cosRot - plane.y * sinRot;
-        plane.y = oldPlaneX * sinRot + plane.y * cosRot;
+        const double oldPlaneX = camera.plane.x;
+        camera.plane.x = camera.plane.x * cosRot - camera.plane.y * sinRot;
+        camera.plane.y = oldPlaneX * sinRot + camera.plane.y * cosRot;
     }
 }
 
-inline int PosMod(const int i, const int n)
-{
-    return (i % n + n) % n;
-}
-
 void DrawMap()
 {
     SDL_SetRenderTarget(renderer, mapTexture);
@@ -409,8 +669,8 @@ void DrawMap()
     SDL_RenderClear(renderer);
 
     IVector viewportWorldPosition = {
-        static_cast<int>(position.x * TILE_WIDTH) - MINIMAP_SIZE / 2,
-        static_cast<int>(position.y * TILE_HEIGHT) - MINIMAP_SIZE / 2
+        static_cast<int>(camera.position.x * TILE_WIDTH) - MINIMAP_SIZE / 2,
+        static_cast<int>(camera.position.y * TILE_HEIGHT) - MINIMAP_SIZE / 2
     };
     IVector viewportTilePosition = {viewportWorldPosition.x / TILE_WIDTH, viewportWorldPosition.y / TILE_HEIGHT};
     IVector viewportTileOffset = {viewportWorldPosition.x % TILE_WIDTH, viewportWorldPosition.y % TILE_HEIGHT};
@@ -419,9 +679,9 @@ void DrawMap()
     {
         for (int y = viewportTilePosition.y; y <= viewportTilePosition.y + MINIMAP_TILES_HIGH + 1; y++)
         {
-            if (x < 0 || x >= MAP_WIDTH || y < 0 || y >= MAP_HEIGHT) continue;
+            if (x < 0 || x >= level.mapWidth || y < 0 || y >= level.mapHeight) continue;
 
-            const auto texIndex = worldMap[x][y];
+            const auto texIndex = Level_GetWall(&level, x, y);
             if (texIndex > 0)
             {
                 const Texture tex = textures[texIndex - 1];
@@ -435,16 +695,16 @@ void DrawMap()
         }
     }
 
-    for (const auto sprite: sprite)
+    for (const auto thing: things)
     {
-        IVector worldPosition = {static_cast<int>(sprite.position.x * TILE_WIDTH) - TILE_WIDTH / 2, static_cast<int>(sprite.position.y * TILE_HEIGHT) - TILE_HEIGHT / 2};
+        IVector worldPosition = {static_cast<int>(thing.position.x * TILE_WIDTH) - TILE_WIDTH / 2, static_cast<int>(thing.position.y * TILE_HEIGHT) - TILE_HEIGHT / 2};
 
         if (worldPosition.x + TILE_WIDTH < viewportWorldPosition.x || worldPosition.x > viewportWorldPosition.x + MINIMAP_SIZE  ||
             worldPosition.y + TILE_WIDTH < viewportWorldPosition.y || worldPosition.y > viewportWorldPosition.y + MINIMAP_SIZE) continue;
 
         IVector screenCoordinates = {worldPosition.x - viewportWorldPosition.x, worldPosition.y - viewportWorldPosition.y};
 
-        Texture tex = textures[sprite.tex];
+        Texture tex = textures[thing.textureIndex];
         SDL_Rect dstRect = {
             screenCoordinates.y,
             screenCoordinates.x,
@@ -461,13 +721,13 @@ void DrawMap()
         playerSize,
         playerSize
     };
-    SDL_RenderCopyExF( renderer, textures[0].tex, nullptr, &playerRect, std::atan2(direction.y, direction.x * -1) * (180 / std::numbers::pi), nullptr, SDL_FLIP_NONE);
+    SDL_RenderCopyExF( renderer, textures[0].tex, nullptr, &playerRect, std::atan2(camera.direction.y, camera.direction.x * -1) * (180 / std::numbers::pi), nullptr, SDL_FLIP_NONE);
 
     SDL_SetRenderTarget(renderer, minimapTargetTexture);
     SDL_RenderCopy(renderer, minimapMask, nullptr, nullptr);
 
     SDL_SetTextureBlendMode(mapTexture, SDL_BLENDMODE_MOD);
-    // SDL_RenderCopyEx( renderer, mapTexture, nullptr, nullptr, std::atan2(direction.y * -1, direction.x * -1) * (180 / std::numbers::pi), nullptr, SDL_FLIP_NONE);
+    // SDL_RenderCopyEx( renderer, mapTexture, nullptr, nullptr, std::atan2(camera.direction.y * -1, camera.direction.x * -1) * (180 / std::numbers::pi), nullptr, SDL_FLIP_NONE);
     SDL_RenderCopy( renderer, mapTexture, nullptr, nullptr);
     SDL_SetTextureBlendMode(mapTexture, SDL_BLENDMODE_BLEND);
 
@@ -476,38 +736,40 @@ void DrawMap()
     SDL_RenderCopy(renderer, minimapTargetTexture, nullptr, &destRect);
 }
 
+// Debug view in place of the minimap: the selected heatmap of the last game frame.
+void DrawHeatmap()
+{
+    void* pixels;
+    int pitch;
+    SDL_LockTexture(heatmapTexture, nullptr, &pixels, &pitch);
+    RenderStats_DrawHeatmap(&renderStats, heatmapMode, static_cast<Pixel*>(pixels));
+    SDL_UnlockTexture(heatmapTexture);
+
+    constexpr SDL_Rect destRect = {SCREEN_WIDTH, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    SDL_RenderCopy(renderer, heatmapTexture, nullptr, &destRect);
+}
 
-//sort algorithm
-//sort the sprites based on distance
-void sortSprites(int* order, double* dist, int amount)
+template<typename Shader>
+void DrawGameView(const Shader& shader, typename Shader::Output* buffer)
 {
-    std::vector<std::pair<double, int>> sprites(amount);
-    for (int i = 0; i < amount; i++)
+    if (incremental)
     {
-        sprites[i].first = dist[i];
-        sprites[i].second = order[i];
+        Renderer_DrawViewIncremental(shader, &level, &camera, buffer, GAME_WIDTH, GAME_HEIGHT, &renderScratch, &incrementalCache);
+        reportRedrawnColumns += incrementalCache.redrawnColumns;
     }
-    std::ranges::sort(sprites);
-    // restore in reverse order to go from farthest to nearest
-    for (int i = 0; i < amount; i++)
+    else if (interlaced)
     {
-        dist[i] = sprites[amount - i - 1].first;
-        order[i] = sprites[amount - i - 1].second;
+        Renderer_DrawViewInterlaced(shader, &level, &camera, buffer, GAME_WIDTH, GAME_HEIGHT, &renderScratch, &interlaceHistory);
+        reportReprojectedColumns += interlaceHistory.reprojectedColumns;
+    }
+    else if (columnMajor)
+    {
+        Renderer_DrawViewTransposed(shader, &level, &camera, buffer, GAME_WIDTH, GAME_HEIGHT, &renderScratch);
+    }
+    else
+    {
+        Renderer_DrawViewWith(shader, &level, &camera, buffer, GAME_WIDTH, GAME_HEIGHT, &renderScratch);
     }
-}
-
-void Darken(Pixel* p, const double shadingPerc)
-{
-    p->r = p->r * (1.0 - shadingPerc);
-    p->g = p->g * (1.0 - shadingPerc);
-    p->b = p->b * (1.0 - shadingPerc);
-}
-
-void Lighten(Pixel* p, const double lightness)
-{
-    p->r = std::min(p->r * lightness, 255.0);
-    p->g = std::min(p->g * lightness, 255.0);
-    p->b = std::min(p->b * lightness, 255.0);
 }
 
 void DrawGame()
@@ -517,332 +779,258 @@ void DrawGame()
     SDL_LockTexture(gameTexture, nullptr, &pixels, &pitch);
     auto buffer = static_cast<uint32_t *>(pixels);
 
-    for (int x = 0; x < GAME_WIDTH; x++)
+    if (renderScratch.stats != nullptr)
     {
-        for (int y = 0; y < GAME_HEIGHT; y++)
-        {
-            buffer[y * GAME_WIDTH + x] = 0;
-        }
+        RenderStats_Begin(renderScratch.stats, GAME_WIDTH, GAME_HEIGHT);
     }
 
-    const Texture skyTexure = textures[11];
+    const Uint64 renderStart = SDL_GetPerformanceCounter();
 
-    for (int x = 0; x < GAME_WIDTH; x++)
+    if (palettized)
     {
-        const double cameraX = 2 * x / static_cast<double>(GAME_WIDTH) - 1;
-        const double playerAngle = std::atan2(direction.y, direction.x);
-        const double textureColumn = skyTexure.width * ((std::atan2(1, cameraX) + playerAngle) / std::numbers::pi);
-        const int texX = static_cast<int>(textureColumn) & skyTexure.width - 1;
-
-        int rowStep = skyTexure.height / GAME_HEIGHT;
-        for (int y = 0; y < GAME_HEIGHT / 2; y++)
-        {
-            const int texY = y * rowStep;
-            buffer[y * GAME_WIDTH + x] = skyTexure.pixels[texY * skyTexure.width + texX].rgba;
-        }
+        uint8_t* indexed = FrameArena_AllocArray<uint8_t>(&renderScratch.arena, GAME_WIDTH * GAME_HEIGHT);
+        DrawGameView(IndexedShader{renderPalette}, indexed);
+        Palette_Expand(renderPalette, indexed, buffer, GAME_WIDTH * GAME_HEIGHT);
     }
-
-    const Texture floorTexture = textures[3];
-
-    for (int y = GAME_HEIGHT / 2; y < GAME_HEIGHT; y++)
+    else if (deferred)
     {
-        Vector leftMostRay = {direction.x - plane.x, direction.y - plane.y};
-        Vector rightMostRay = {direction.x + plane.x, direction.y + plane.y};
-
-        double positionZ = 0.5 * GAME_HEIGHT;
-        int p = y - GAME_HEIGHT / 2;
-        double rowDistance = positionZ / p;
-
-        Vector floorStep = {
-            rowDistance * (rightMostRay.x - leftMostRay.x) / GAME_WIDTH,
-            rowDistance * (rightMostRay.y - leftMostRay.y) / GAME_WIDTH
-        };
-        Vector floor = {
-            position.x + rowDistance * leftMostRay.x,
-            position.y + rowDistance * leftMostRay.y
-        };
-
-        double shadingPerc = 1 - p / positionZ - 0.25;
-        shadingPerc = std::min(shadingPerc, 0.75);
-        shadingPerc = std::max(shadingPerc, 0.0);
-
-        for (int x = 0; x < GAME_WIDTH; x++)
-        {
-            IVector cell = {PosMod(static_cast<int>(floor.x), MAP_WIDTH), PosMod(static_cast<int>(floor.y), MAP_HEIGHT)};
-
-            IVector floorTexCoord = {
-                static_cast<int>(floorTexture.width * (floor.x - cell.x)) & (floorTexture.width - 1),
-                static_cast<int>(floorTexture.height * (floor.y - cell.y)) & (floorTexture.height - 1)
-            };
-
-            Pixel floorPixel = floorTexture.pixels[floorTexCoord.y * floorTexture.width + floorTexCoord.x];
-            Darken(&floorPixel, shadingPerc);
-            Lighten(&floorPixel, lightMap[cell.x][cell.y]);
-            buffer[y * GAME_WIDTH + x] = floorPixel.rgba;
-
-
-            auto ceilingTexIndex = ceilingMap[cell.x][cell.y];
-            if (ceilingTexIndex > 0)
-            {
-                Texture ceilingTexture = textures[ceilingTexIndex];
+        uint32_t* gbuffer = FrameArena_AllocArray<uint32_t>(&renderScratch.arena, GAME_WIDTH * GAME_HEIGHT);
+        DrawGameView(DeferredShader{}, gbuffer);
+        Deferred_Shade(gbuffer, buffer, GAME_WIDTH, GAME_HEIGHT, shadingPool.get());
+    }
+    else
+    {
+        DrawGameView(RgbaShader{}, buffer);
+    }
 
-                IVector ceilTexCoord = {
-                    static_cast<int>(ceilingTexture.width * (floor.x - cell.x)) & (ceilingTexture.width - 1),
-                    static_cast<int>(ceilingTexture.height * (floor.y - cell.y)) & (ceilingTexture.height - 1)
-                };
+    reportRenderMilliseconds += (SDL_GetPerformanceCounter() - renderStart) * 1000.0 / SDL_GetPerformanceFrequency();
 
-                Pixel ceilPixel = ceilingTexture.pixels[ceilTexCoord.y * ceilingTexture.width + ceilTexCoord.x];
-                Darken(&ceilPixel, shadingPerc);
-                Lighten(&ceilPixel, ceilingLightMap[cell.x][cell.y]);
-                buffer[(GAME_HEIGHT - y - 1) * GAME_WIDTH + x] = ceilPixel.rgba;
-            }
+    if (renderScratch.stats != nullptr)
+    {
+        RenderCounters_Accumulate(&reportCounters, &renderScratch.stats->counters);
+    }
 
+    SDL_UnlockTexture(gameTexture);
+    SDL_Rect destRect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    SDL_RenderCopy(renderer, gameTexture, nullptr, &destRect);
+}
 
-            floor.x += floorStep.x;
-            floor.y += floorStep.y;
-        }
+// Returns false when nothing had to be drawn.
+bool Draw()
+{
+    // Nothing moved or changed since the last frame, the window still shows it
+    if (incremental && !Incremental_HasChanged(&incrementalCache, &level, &camera))
+    {
+        ++reportSkippedFrames;
+        return false;
     }
 
-    for (int x = 0; x < GAME_WIDTH; x++)
+    SDL_SetRenderDrawColor(renderer, 255, 0x00, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    DrawGame();
+    if (heatmapMode != HEATMAP_OFF)
+    {
+        DrawHeatmap();
+    }
+    else
     {
-        const double cameraX = 2 * x / static_cast<double>(GAME_WIDTH) - 1;
-        const Vector rayDirection = {direction.x + plane.x * cameraX, direction.y + plane.y * cameraX};
-        IVector mapPosition = {static_cast<int>(position.x), static_cast<int>(position.y)};
-        Vector sideDist;
-        Vector deltaDist = {rayDirection.x == 0 ? 1e30 : std::abs(1 / rayDirection.x), rayDirection.y == 0 ? 1e30 : std::abs(1 / rayDirection.y)};
-        double perpWallDist;
-        IVector step;
-        bool hit = false;
-        int side = 0;
+        DrawMap();
+    }
+    SDL_RenderPresent(renderer);
+    return true;
+}
 
-        if (rayDirection.x < 0)
-        {
-            step.x = -1;
-            sideDist.x = (position.x - mapPosition.x) * deltaDist.x;
-        }
-        else
-        {
-            step.x = 1;
-            sideDist.x = (mapPosition.x + 1.0 - position.x) * deltaDist.x;
-        }
 
-        if (rayDirection.y < 0)
-        {
-            step.y = -1;
-            sideDist.y = (position.y - mapPosition.y) * deltaDist.y;
-        }
-        else
-        {
-            step.y = 1;
-            sideDist.y = (mapPosition.y + 1.0 - position.y) * deltaDist.y;
-        }
+int main(int argc, char* argv[])
+{
+    setbuf(stdout, nullptr);
 
-        while (!hit)
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--incremental") == 0)
         {
-            if (sideDist.x < sideDist.y)
-            {
-                sideDist.x += deltaDist.x;
-                mapPosition.x += step.x;
-                side = 0;
-            }
-            else
-            {
-                sideDist.y += deltaDist.y;
-                mapPosition.y += step.y;
-                side = 1;
-            }
-
-            if (worldMap[mapPosition.x][mapPosition.y] > 0)
-            {
-                hit = true;
-            }
+            incremental = true;
         }
-
-        if (side == 0)
+        else if (std::strcmp(argv[i], "--world") == 0 && i + 1 < argc)
         {
-            perpWallDist = (sideDist.x - deltaDist.x);
+            worldPath = argv[++i];
         }
-        else
+        else if (std::strcmp(argv[i], "--export-world") == 0 && i + 1 < argc)
         {
-            perpWallDist = (sideDist.y - deltaDist.y);
+            exportWorldPath = argv[++i];
         }
-
-        const int lineHeight = static_cast<int>((GAME_HEIGHT / perpWallDist));
-
-        int drawStart = -lineHeight / 2 + GAME_HEIGHT / 2;
-        if (drawStart < 0)
+        else if (std::strcmp(argv[i], "--publish-assets") == 0 && i + 1 < argc)
         {
-            drawStart = 0;
+            publishAssetsName = argv[++i];
         }
-
-        int drawEnd = lineHeight / 2 + GAME_HEIGHT / 2;
-        if (drawEnd >= GAME_HEIGHT)
+        else if (std::strcmp(argv[i], "--attach-assets") == 0 && i + 1 < argc)
         {
-            drawEnd = GAME_HEIGHT - 1;
+            attachAssetsName = argv[++i];
         }
-
-        const int texNum = worldMap[mapPosition.x][mapPosition.y] - 1;
-        const Texture tex = textures[texNum];
-
-        double wallX;
-        if (side == 0)
+        else if (std::strcmp(argv[i], "--benchmark") == 0)
         {
-            wallX = position.y + perpWallDist * rayDirection.y;
+            benchmarkMode = BENCHMARK_FULL;
         }
-        else
+        else if (std::strcmp(argv[i], "--benchmark-quick") == 0)
         {
-            wallX = position.x + perpWallDist * rayDirection.x;
+            benchmarkMode = BENCHMARK_QUICK;
         }
-        wallX -= std::floor(wallX);
-
-        int texX = static_cast<int>(wallX * tex.width);
-        if (side == 0 && rayDirection.x > 0) texX = tex.width - texX - 1;
-        if (side == 1 && rayDirection.y < 0) texX = tex.width - texX - 1;
-
-        const double texStep = 1.0 * tex.height / lineHeight;
-        double texPos = (drawStart - GAME_HEIGHT / 2 + lineHeight / 2) * texStep;
-
-        double shadingPerc = std::min(perpWallDist / MAX_VIEW_DIST, 0.75);
-        double lightValue = lightMap[mapPosition.x][mapPosition.y];
-
-        for (int y = drawStart; y < drawEnd; y++)
+        else if (std::strcmp(argv[i], "--stats") == 0)
         {
-            const int texY = static_cast<int>(texPos) & (tex.height - 1);
-            texPos += texStep;
-            auto p = tex.pixels[tex.height * texY + texX];
-            Darken(&p, shadingPerc);
-            Lighten(&p, lightValue);
-            buffer[y * GAME_WIDTH + x] = p.rgba;
+            reportStats = true;
         }
-        ZBuffer[x] = perpWallDist;
     }
+    reportStats = reportStats || AllocTracker_IsEnabled() || RenderStats_IsEnabled();
+
+    Init();
+    Load();
 
-    for (int i = 0; i < NUM_SPRITES; i++)
+    if (benchmarkMode != BENCHMARK_OFF)
     {
-        spriteOrder[i] = i;
-        auto spriteXDist = position.x - sprite[i].position.x;
-        auto spriteYDist = position.y - sprite[i].position.y;
-        spriteDistance[i] = std::sqrt(spriteXDist * spriteXDist + spriteYDist * spriteYDist);
+        const BenchmarkMatrix matrix = benchmarkMode == BENCHMARK_FULL ? BenchmarkMatrix_Full() : BenchmarkMatrix_Quick();
+        Benchmark_Run(&matrix, &level, &benchmarkTextures);
+        Close();
+        return 0;
     }
 
-    sortSprites(spriteOrder, spriteDistance, NUM_SPRITES);
+    Timer fpsTimer;
+    Timer stepTimer;
+    Timer reportTimer;
+    int countedFrames = 0;
+    int reportFrames = 0;
+    uint64_t reportAllocations = 0;
+    fpsTimer.Start();
+    stepTimer.Start();
+    reportTimer.Start();
+    FramePacer_Init(&framePacer, SCREEN_FPS);
 
-    for (int i = 0; i < NUM_SPRITES; i++)
+    while (!quit)
     {
-        Sprite currentSprite = sprite[spriteOrder[i]];
-        Texture tex = textures[currentSprite.tex];
-        Vector spritePosition = {currentSprite.position.x - position.x, currentSprite.position.y - position.y};
+        // Sleep off the frame first, so input is sampled as late as possible before casting starts
+        FramePacer_Wait(&framePacer);
+        ++countedFrames;
 
-        double invDet = 1.0 / (plane.x * direction.y - direction.x * plane.y);
-        Vector transform = {
-            invDet * (direction.y * spritePosition.x - direction.x * spritePosition.y),
-            invDet * (-plane.y * spritePosition.x + plane.x * spritePosition.y)
-        };
+        double avgFPS = countedFrames / (fpsTimer.GetTicks() / 1000.0);
+        if (avgFPS > 2000000)
+        {
+            avgFPS = 0;
+        }
+
+        const double frameTime = stepTimer.GetTicks() / 1000.0;
 
-        int spriteScreenX = static_cast<int>(GAME_WIDTH / 2 * (1 + transform.x / transform.y));
+        FrameArena_Reset(&renderScratch.arena);
+        const uint64_t allocationsBefore = AllocTracker_GetCount();
 
-        int spriteHeight = std::abs(static_cast<int>(GAME_HEIGHT / transform.y));
-        int drawStartY = -spriteHeight / 2 + GAME_HEIGHT / 2;
-        if (drawStartY < 0)
+        Update(frameTime);
+        stepTimer.Start();
+        if (quit)
         {
-            drawStartY = 0;
+            break;
         }
-        int drawEndY = spriteHeight / 2 + GAME_HEIGHT / 2;
-        if (drawEndY >= GAME_HEIGHT)
+
+        if (level.world != nullptr)
         {
-            drawEndY = GAME_HEIGHT - 1;
+            level.world->Update(camera.position, MAX_VIEW_DIST);
         }
 
-        int spriteWidth = std::abs(static_cast<int>(GAME_HEIGHT / transform.y));
-        int drawStartX = -spriteWidth / 2 + spriteScreenX;
-        if (drawStartX < 0)
+        if (Draw())
         {
-            drawStartX = 0;
+            PendingInput_Presented(&pendingInput, &reportLatency);
         }
-        int drawEndX = spriteWidth / 2 + spriteScreenX;
-        if (drawEndX >= GAME_WIDTH)
+        else
         {
-            drawEndX = GAME_WIDTH - 1;
+            // The input changed nothing on screen, so it has no latency to measure
+            pendingInput.count = 0;
         }
+        FramePacer_FrameDone(&framePacer);
 
-        double shadingPerc = std::min(spriteDistance[i] / MAX_VIEW_DIST, 0.75);
-
-        for (int stripe = drawStartX; stripe < drawEndX; stripe++)
+        const uint64_t frameAllocations = AllocTracker_GetCount() - allocationsBefore;
+#ifdef ASSERT_ZERO_ALLOCATIONS
+        // Not SDL_assert, which release builds compile out
+        if (countedFrames > ALLOCATION_WARMUP_FRAMES && frameAllocations > 0)
         {
-            int texX = 256 * (stripe - (-spriteWidth / 2 + spriteScreenX)) * tex.width / spriteWidth / 256;
+            printf("frame %d allocated %llu times after warm-up\n", countedFrames, static_cast<unsigned long long>(frameAllocations));
+            abort();
+        }
+#endif
+        reportAllocations += frameAllocations;
+        ++reportFrames;
 
-            if (transform.y > 0 && stripe > 0 && stripe < GAME_WIDTH && transform.y < ZBuffer[stripe])
+        if (reportTimer.GetTicks() >= STATS_REPORT_TICKS)
+        {
+            if (reportStats)
             {
-                for (int y = drawStartY; y < drawEndY; y++)
+                printf("fps: %.1f | render: %.2f ms", avgFPS, reportRenderMilliseconds / reportFrames);
+                if (AllocTracker_IsEnabled())
+                {
+                    printf(" | allocations/frame: %.2f", static_cast<double>(reportAllocations) / reportFrames);
+                }
+                if (reportLatency.total > 0)
+                {
+                    printf(" | input latency: p50 %u ms, p95 %u ms, max %u ms", LatencyHistogram_GetPercentile(&reportLatency, 0.5),
+                           LatencyHistogram_GetPercentile(&reportLatency, 0.95), reportLatency.maxMilliseconds);
+                }
+                if (incremental)
+                {
+                    printf(" | redrawn: %.1f%% | skipped frames: %d", 100.0 * reportRedrawnColumns / (static_cast<double>(reportFrames) * GAME_WIDTH), reportSkippedFrames);
+                }
+                if (interlaced)
+                {
+                    printf(" | reprojected: %.1f%%", 100.0 * reportReprojectedColumns / (static_cast<double>(reportFrames) * GAME_WIDTH));
+                }
+                if (rayCacheEnabled && rayCache.reusedRays + rayCache.castRays > 0)
+                {
+                    printf(" | rays reused: %.1f%%", 100.0 * rayCache.reusedRays / static_cast<double>(rayCache.reusedRays + rayCache.castRays));
+                }
+                if (level.world != nullptr)
                 {
-                    int d = y * 256 - GAME_HEIGHT * 128 + spriteHeight * 128;
-                    int texY = d * tex.height / spriteHeight / 256;
-                    auto p = tex.pixels[texY * tex.width + texX];
-                    if (p.r != 0 || p.g != 0 || p.b != 0)
+                    const ChunkedWorldStats paging = level.world->GetStats();
+                    printf(" | chunks: %d resident, %d loading | hits: %llu | misses: %llu | evictions: %llu | in flight: %llu KB",
+                           paging.residentChunks, paging.loadingChunks, static_cast<unsigned long long>(paging.hits),
+                           static_cast<unsigned long long>(paging.misses), static_cast<unsigned long long>(paging.evictions),
+                           static_cast<unsigned long long>(paging.bytesInFlight / 1024));
+                    if (paging.readFailures > 0)
                     {
-                        Darken(&p, shadingPerc);
-                        Lighten(&p, lightMap[static_cast<int>(currentSprite.position.x)][static_cast<int>(currentSprite.position.y)]);
-                        buffer[y * GAME_WIDTH + stripe] = p.rgba;
+                        printf(" | read failures: %llu", static_cast<unsigned long long>(paging.readFailures));
                     }
                 }
+                if (RenderStats_IsEnabled())
+                {
+                    const double frames = reportFrames;
+                    const double screenPixels = frames * GAME_WIDTH * GAME_HEIGHT;
+                    printf(" | steps/ray: %.1f | texels/frame: %.0f | overdraw: %.2f (",
+                           static_cast<double>(reportCounters.ddaSteps) / std::max<uint64_t>(reportCounters.raysCast, 1),
+                           reportCounters.texelFetches / frames,
+                           RenderCounters_GetPixelsWritten(&reportCounters) / screenPixels);
+                    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++)
+                    {
+                        printf("%s%s %.2f", pass > 0 ? ", " : "", RenderPass_GetName(static_cast<RenderPass>(pass)), reportCounters.pixelsWritten[pass] / screenPixels);
+                    }
+                    printf(") | sprites drawn: %.1f/%.1f | zbuffer rejections/frame: %.0f",
+                           reportCounters.spritesDrawn / frames, reportCounters.spritesConsidered / frames, reportCounters.zBufferRejections / frames);
+                }
+                printf("\n");
             }
+            reportFrames = 0;
+            reportAllocations = 0;
+            reportRenderMilliseconds = 0;
+            reportReprojectedColumns = 0;
+            reportCounters = {};
+            reportRedrawnColumns = 0;
+            reportSkippedFrames = 0;
+            rayCache.reusedRays = 0;
+            rayCache.castRays = 0;
+            LatencyHistogram_Merge(&sessionLatency, &reportLatency);
+            LatencyHistogram_Clear(&reportLatency);
+            reportTimer.Start();
         }
     }
 
-    SDL_UnlockTexture(gameTexture);
-    SDL_Rect destRect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-    SDL_RenderCopy(renderer, gameTexture, nullptr, &destRect);
-}
-
-void Draw()
-{
-    SDL_SetRenderDrawColor(renderer, 255, 0x00, 255, SDL_ALPHA_OPAQUE);
-    SDL_RenderClear(renderer);
-    DrawGame();
-    DrawMap();
-    SDL_RenderPresent(renderer);
-}
-
-
-int main(int argc, char* argv[])
-{
-    setbuf(stdout, nullptr);
-
-    Init();
-    Load();
-
-    Timer capTimer;
-    Timer fpsTimer;
-    Timer stepTimer;
-    int countedFrames = 0;
-    fpsTimer.Start();
-    stepTimer.Start();
-
-    while (!quit)
+    LatencyHistogram_Merge(&sessionLatency, &reportLatency);
+    if (reportStats)
     {
-        capTimer.Start();
-        ++countedFrames;
-
-        double avgFPS = countedFrames / (fpsTimer.GetTicks() / 1000.0);
-        if (avgFPS > 2000000)
-        {
-            avgFPS = 0;
-        }
-
-        const double frameTime = stepTimer.GetTicks() / 1000.0;
-
-        Draw();
-        Update(frameTime);
-
-        stepTimer.Start();
-
-        const int frameTicks = capTimer.GetTicks();
-        if (frameTicks < SCREEN_TICKS_PER_FRAME)
-        {
-            SDL_Delay(SCREEN_TICKS_PER_FRAME - frameTicks);
-        }
+        LatencyHistogram_Print(&sessionLatency);
     }
-
     Close();
     return 0;
 }